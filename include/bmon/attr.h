@@ -44,6 +44,9 @@ struct rate
 	/* Rate per second calculated every `rate_interval' */
 	float			r_rate;
 
+	/* Value of r_total at last calculation */
+	uint64_t		r_calc_total;
+
 	/* Time of last calculation */
 	timestamp_t		r_last_calc;
 };
@@ -60,6 +63,7 @@ struct attr_def {
 	char *			ad_description;
 	int			ad_type;
 	int			ad_flags;
+	int			ad_demand;
 	struct unit *		ad_unit;
 
 	struct list_head	ad_list;
@@ -72,6 +76,27 @@ extern struct attr_def *	attr_def_lookup_id(int);
 
 #define ATTR_DEF_FLAG_HISTORY		0x01	/* collect history */
 
+/*
+ * Attributes consumed by the outputs. Unless an output consuming all
+ * attributes is active, only attributes declared with attr_demand()
+ * are collected.
+ */
+#define ATTR_DEMAND_VALUE		0x01	/* counter and rate */
+#define ATTR_DEMAND_HISTORY		0x02	/* history */
+
+extern int			attr_demand_restricted;
+extern unsigned int		attr_demand_version;
+
+extern void			attr_demand(const char *, int);
+extern void			attr_demand_def(struct attr_def *, int);
+extern void			attr_demand_all(int);
+extern void			attr_demand_restrict(void);
+extern void			attr_history_always(void);
+
+static inline int attr_def_demanded(struct attr_def *def, int what)
+{
+	return !attr_demand_restricted || (def->ad_demand & what);
+}
 
 #define ATTR_FLAG_RX_ENABLED		0x01	/* has RX counter */
 #define ATTR_FLAG_TX_ENABLED		0x02	/* has TX counter */
@@ -89,11 +114,11 @@ struct attr
 
 	uint8_t			a_flags;
 	struct attr_def *	a_def;
-	timestamp_t		a_last_update;
 
 	struct list_head	a_history_list;
+	/* history_view_version when the histories were attached */
+	unsigned int		a_history_version;
 
-	struct list_head	a_list;
 	struct list_head	a_sort_list;
 };
 
@@ -102,7 +127,8 @@ extern int			attr_ignore_overflows(struct attr *);
 extern struct attr *		attr_lookup(const struct element *, int);
 extern void			attr_update(struct element *, int,
 					    uint64_t, uint64_t , int );
-extern void			attr_notify_update(struct attr *,
+extern void			attr_notify_update(struct element *,
+						   struct attr *,
 						   timestamp_t *);
 extern void			attr_free(struct attr *);
 
@@ -113,12 +139,41 @@ extern void			attr_rate2float(struct attr *,
 extern void			attr_calc_usage(struct attr *, float *, float *,
 						uint64_t, uint64_t);
 
-#define ATTR_HASH_SIZE 32
-
 #define UPDATE_FLAG_RX			0x01
 #define UPDATE_FLAG_TX			0x02
 #define UPDATE_FLAG_64BIT		0x04
 
+/*
+ * Attribute map of an input, registered once and then used to update
+ * all attributes of an element from a vector of values.
+ */
+#define ATTR_BATCH_MAX			64
+#define ATTR_BATCH_ALL			(~0ULL)
+
+struct attr_batch_entry
+{
+	struct attr_def *	be_def;
+	int			be_flags;
+};
+
+struct attr_batch
+{
+	unsigned int		ab_nentries;
+	int			ab_max_id;
+	struct attr_batch_entry	ab_entries[ATTR_BATCH_MAX];
+
+	/* entries in demand as of ab_demand_version */
+	uint64_t		ab_demand;
+	unsigned int		ab_demand_version;
+};
+
+extern int			attr_batch_add(struct attr_batch *, int, int);
+extern uint64_t			attr_batch_demand(struct attr_batch *);
+extern void			attr_update_batch(struct element *,
+						  struct attr_batch *,
+						  const uint64_t *,
+						  const uint64_t *, uint64_t);
+
 enum {
 	ATTR_UNSPEC,
 	ATTR_BYTES,
@@ -155,7 +210,10 @@ extern struct attr *		attr_select_next(void);
 extern struct attr *		attr_select_prev(void);
 extern struct attr *		attr_current(void);
 
-extern void			attr_collect_history(struct attr *);
+extern void			attr_collect_history(struct element *,
+						     struct attr *);
+extern void			attr_demand_attr(struct element *,
+						 struct attr *, int);
 #if 0
 struct item;
 struct history;
@@ -29,6 +29,7 @@
 #include <bmon/list.h>
 
 extern int start_time;
+extern int do_quit;
 
 typedef struct timestamp_s
 {
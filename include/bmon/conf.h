@@ -33,6 +33,7 @@ extern float			cfg_read_interval;
 extern float			cfg_rate_interval;
 extern float			cfg_rate_variance;
 extern float			cfg_history_variance;
+extern unsigned int		cfg_lifecycles;
 extern int			cfg_show_all;
 extern int			cfg_unit_exp;
 
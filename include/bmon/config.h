@@ -94,6 +94,10 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #if defined HAVE_GETOPT_H
 #include <getopt.h>
 #endif
@@ -107,6 +111,12 @@
 #include <sys/utsname.h>
 #endif
 
+#if defined HAVE_SYS_TIMERFD_H && defined HAVE_SYS_EPOLL_H
+#include <sys/timerfd.h>
+#include <sys/epoll.h>
+#define HAVE_EVENT_LOOP
+#endif
+
 #if defined HAVE_NCURSES
 #  if defined HAVE_NCURSES_NCURSES_H
 #    include <ncurses/ncurses.h>
@@ -32,18 +32,18 @@
 #define MAX_GRAPHS 32
 #define IFNAME_MAX 32
 
-struct policy
-{
-	char *			p_rule;
-	struct list_head	p_list;
-};
-
 struct element_cfg;
 
+/*
+ * Informational key/value pairs of an element. Keys are interned with
+ * element_info_key(), each element keeps a slot per key.
+ */
 struct info
 {
-	char *			i_name;
+	const char *		i_name;
 	char *			i_value;
+	uint64_t		i_num;		/* see element_info_stale() */
+	int			i_has_num;
 	struct list_head	i_list;
 };
 
@@ -52,22 +52,36 @@ struct element
 	char *			e_name;
 	char *			e_description;
 	uint32_t		e_id;
+	uint32_t		e_index;	/* input specific, e.g. ifindex */
 	uint32_t		e_flags;
-	unsigned int		e_lifecycles;
 	unsigned int		e_level;	/* recursion level */
 
+	/* Generation last updated in and generation the element expires */
+	unsigned int		e_generation;
+	unsigned int		e_expire;
+	struct list_head	e_expire_list;
+
 	struct element *	e_parent;
 	struct element_group *	e_group;
 
 	struct list_head	e_list;
 	struct list_head	e_childs;
 
+	unsigned int		e_hash;
+	struct list_head	e_hash_list;
+	struct list_head	e_index_list;
+
 	unsigned int		e_nattrs;
-	struct list_head	e_attrhash[ATTR_HASH_SIZE];
+
+	/* Attributes indexed by attribute id, see attr_lookup() */
+	struct attr *		e_attrs;
+	unsigned int		e_attrs_size;
 	struct list_head	e_attr_sorted;
 
 	unsigned int		e_ninfo;
-	struct list_head	e_info_list;
+	struct list_head	e_info_list;	/* in order of creation */
+	struct info **		e_info;		/* indexed by info key */
+	unsigned int		e_info_size;
 
 	struct attr_def *	e_key_attr[__GT_MAX];
 	struct attr_def *	e_usage_attr;
@@ -80,26 +94,43 @@ struct element
 	struct attr *		e_current_attr;
 };
 
+extern struct element *		element_find(struct element_group *,
+					     const char *, uint32_t,
+					     struct element *);
 extern struct element *		element_lookup(struct element_group *,
 					       const char *, uint32_t,
 					       struct element *);
 
+extern struct element *		element_find_index(struct element_group *,
+						   uint32_t, struct element *);
+extern void			element_set_index(struct element *, uint32_t);
+
 extern void			element_free(struct element *);
 
-extern void			element_reset_update_flag(struct element_group *,
-							  struct element *,
-							  void *);
+extern unsigned int		element_generation;
+
+extern void			element_next_generation(void);
 extern void			element_notify_update(struct element *,
 						      timestamp_t *);
 extern void			element_lifesign(struct element *, int);
-extern void			element_check_if_dead(struct element_group *,
-						      struct element *, void *);
+extern void			element_expire(void);
+
+/* Element has been updated by the current read */
+static inline int element_updated(struct element *e)
+{
+	return e->e_generation == element_generation;
+}
+
+/* Number of reads left before the element expires */
+static inline int element_lifecycles(struct element *e)
+{
+	return (int) (e->e_expire - element_generation);
+}
 
 extern void			element_set_key_attr(struct element *, int, int);
 extern void			element_set_usage_attr(struct element *, int);
 
 #define ELEMENT_FLAG_FOLDED	(1 << 0)
-#define ELEMENT_FLAG_UPDATED	(1 << 1)
 #define ELEMENT_FLAG_EXCLUDE	(1 << 2)
 #define ELEMENT_FLAG_CREATED	(1 << 3)
 
@@ -114,9 +145,11 @@ extern struct element *		element_select_last(void);
 extern struct element *		element_select_next(void);
 extern struct element *		element_select_prev(void);
 
-extern int			element_allowed(const char *, struct element_cfg *);
-extern void			element_parse_policy(const char *);
-
+extern int			element_info_key(const char *);
+extern void			element_set_info(struct element *, int,
+						 const char *);
+extern int			element_info_stale(struct element *, int,
+						   uint64_t);
 extern void			element_update_info(struct element *,
 						    const char *,
 						    const char *);
@@ -47,5 +47,9 @@ extern struct element_cfg *	element_cfg_alloc(const char *);
 extern struct element_cfg *	element_cfg_create(const char *);
 extern void			element_cfg_free(struct element_cfg *);
 extern struct element_cfg *	element_cfg_lookup(const char *);
+extern void			element_cfg_foreach(
+					void (*cb)(struct element_cfg *,
+						   void *),
+					void *);
 
 #endif
@@ -39,6 +39,9 @@ struct graph_cfg {
 				gc_foreground,
 				gc_noise,
 				gc_unknown;
+
+	/* consolidation function drawn for consolidated tiers */
+	int			gc_cf;
 	
 	struct unit *		gc_unit;
 };
@@ -63,6 +63,11 @@ struct element_group
 	struct list_head	g_elements;
 	unsigned int		g_nelements;
 
+	/* Element hash tables, see element_lookup() */
+	struct list_head *	g_hash;
+	struct list_head *	g_index_hash;
+	unsigned int		g_hash_size;
+
 	/* Currently selected element in this group */
 	struct element *	g_current;
 
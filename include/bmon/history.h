@@ -27,6 +27,7 @@
 
 #include <bmon/bmon.h>
 #include <bmon/attr.h>
+#include <bmon/sketch.h>
 
 #define HISTORY_UNKNOWN		((uint64_t) -1)
 #define HBEAT_TRIGGER		60.0f
@@ -36,14 +37,43 @@ enum {
 	HISTORY_TYPE_16	= 2,
 	HISTORY_TYPE_32	= 4,
 	HISTORY_TYPE_64	= 8,
+	/* delta-of-delta varint encoded blocks, 64bit precision */
+	HISTORY_TYPE_COMPRESSED = 16,
 };
 
+/* rx/tx pairs per block of a compressed history */
+#define HISTORY_BLOCK_SAMPLES	64
+
+/* consolidation functions of a tier */
+enum {
+	HISTORY_CF_AVG,
+	HISTORY_CF_MIN,
+	HISTORY_CF_MAX,
+	__HISTORY_CF_MAX,
+};
+
+#define HISTORY_DEF_FLAG_VIEWED	0x01	/* displayed by an output */
+#define HISTORY_DEF_FLAG_QUANTILES 0x02	/* sketch rates of every interval */
+
 struct history_def
 {
 	char *			hd_name;
 	int			hd_size,
 				hd_type;
 	float			hd_interval;
+	int			hd_flags;
+
+	/* tier this definition is consolidated from */
+	struct history_def *	hd_base;
+	/* intervals of hd_base consolidated per interval */
+	int			hd_steps;
+	/* values stored per interval, a rx/tx pair per function */
+	int			hd_values;
+
+	/* size of a ring in the history arena, rx and tx interleaved */
+	size_t			hd_ring_size;
+	/* rings released to the arena */
+	void *			hd_free_rings;
 
 	struct list_head	hd_list;
 };
@@ -51,10 +81,39 @@ struct history_def
 struct history_store
 {
 	/* TODO? store error ratio? */
-	void *			hs_data;
+	/* slot of this direction within an interleaved rx/tx pair */
+	int			hs_offset;
 	uint64_t		hs_prev_total;
 };
 
+/* intervals of the base tier consolidated so far */
+struct history_cons
+{
+	uint64_t		hc_sum[2],
+				hc_min[2],
+				hc_max[2];
+	int			hc_known[2];
+	int			hc_steps;
+};
+
+/*
+ * Rate quantiles of a tier. The rates measured at every read are added
+ * to the sketch of the base tier, a completed interval is merged into
+ * the current interval of the tiers above.
+ */
+struct history_quant
+{
+	struct sketch		hq_cur[2],
+				hq_last[2];
+
+	/* counters and time of the previous read */
+	uint64_t		hq_prev[2];
+	timestamp_t		hq_prev_ts;
+};
+
+/* name of a history in the history file: "def:group/element/attr" */
+#define HISTORY_KEY_MAX		120
+
 struct history
 {
 	/* index to current entry in data array */
@@ -67,21 +126,68 @@ struct history
 	float			h_min_interval,
 				h_max_interval;
 
+	/* ring of hd_size rx/tx pairs, allocated with the first sample */
+	void *			h_data;
+
 	struct history_store	h_rx,
 				h_tx;
 
+	struct history_cons	h_cons;
+
+	/* NULL unless the definition collects quantiles */
+	struct history_quant *	h_quant;
+
+	/* record in the history file, NULL if kept in the arena */
+	void *			h_record;
+	/* name for the history file, NULL if not persistent */
+	char *			h_key;
+	struct list_head	h_file_list;
+};
+
+struct history_usage
+{
+	/* bytes allocated for the arena, packed blocks and sketches */
+	size_t			hu_reserved;
+	/* bytes in use by rings, packed blocks and sketches */
+	size_t			hu_used;
+	unsigned int		hu_rings;
 };
 
+extern unsigned int		history_view_version;
+
 extern struct history_def *	history_def_lookup(const char *);
 extern struct history_def *	history_def_alloc(const char *);
 
 extern uint64_t			history_data(struct history *,
 					     struct history_store *, int);
+extern uint64_t			history_data_cf(struct history *,
+						struct history_store *,
+						int, int);
+extern int			history_cf_lookup(const char *);
+extern const char *		history_cf_name(int);
 extern void			history_update(struct attr *,
 					       struct history *, timestamp_t *);
 extern struct history *		history_alloc(struct history_def *);
 extern void			history_free(struct history *);
-extern void			history_attach(struct attr *);
+extern void			history_attach(struct element *,
+					       struct attr *);
+extern void			history_def_view(struct history_def *);
+extern struct history *		history_lookup(struct attr *,
+					       struct history_def *);
+extern struct history_def *	history_quantile_def(void);
+extern int			history_quantile(struct history *, int,
+						 double, double *);
+extern void			history_usage(struct history_usage *);
+
+extern void			history_file_open(const char *, size_t,
+						  float);
+extern size_t			history_file_size(void);
+extern void *			history_file_attach(struct history *,
+						    double *);
+extern void *			history_file_alloc(struct history *);
+extern void			history_file_detach(struct history *);
+extern void			history_file_sync(int);
+extern void			history_file_close(void);
 
 extern struct history_def *	history_select_first(void);
 extern struct history_def *	history_select_last(void);
@@ -36,11 +36,17 @@ extern void input_register(struct bmon_module *);
 
 extern void input_read(void);
 
+extern void input_stamp(timestamp_t *);
+extern timestamp_t *input_timestamp(void);
+
 struct reader_timing
 {
 	timestamp_t rt_last_read;	/* timestamp taken before read */
 	timestamp_t rt_next_read;	/* estimated next read */
 
+	unsigned long rt_reads;		/* number of reads performed */
+	unsigned long rt_wakeups;	/* number of main loop wakeups */
+
 	struct {
 		float v_error;
 		float v_max;
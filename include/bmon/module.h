@@ -35,6 +35,8 @@ typedef enum mod_type_e {
 
 #define BMON_MODULE_ENABLED		1
 #define BMON_MODULE_NO_DEFAULT		2
+#define BMON_MODULE_INTERACTIVE		4	/* reads user input from stdin */
+#define BMON_MODULE_DEMAND		8	/* declares consumed attributes */
 
 struct bmon_module
 {
@@ -48,6 +50,7 @@ struct bmon_module
 	void		      (*m_parse_opt)(const char *, const char *);
 	void		      (*m_pre)(void);
 	void		      (*m_do)(void);
+	void		      (*m_flush)(void);
 	void		      (*m_post)(void);
 
 	int			m_flags;
@@ -29,11 +29,27 @@
 #include <bmon/conf.h>
 #include <bmon/module.h>
 
+struct output_buffer
+{
+	FILE *			ob_file;
+	char *			ob_data;
+	size_t			ob_len;
+};
+
 extern void		output_register(struct bmon_module *);
 extern void		output_set(const char *);
 extern void		output_set_secondary(const char *);
 extern void		output_pre(void);
 extern void		output_draw(void);
 extern void		output_post(void);
+extern void		output_redraw(struct bmon_module *);
+extern int		output_is_interactive(void);
+extern void		output_start(void);
+extern void		output_stop(void);
+extern unsigned long	output_dropped(void);
+
+extern FILE *		output_buffer_open(struct output_buffer *);
+extern void		output_buffer_close(struct output_buffer *);
+extern void		output_buffer_write(struct output_buffer *, FILE *);
 
 #endif
@@ -0,0 +1,71 @@
+/*
+ * readbatch.h            Batched File Reads
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_READBATCH_H_
+#define __BMON_READBATCH_H_
+
+#include <bmon/bmon.h>
+
+enum {
+	READ_BACKEND_PREAD,
+	READ_BACKEND_URING,
+};
+
+struct read_req {
+	int			rr_fd;
+	char *			rr_buf;
+	size_t			rr_len;
+
+	/* number of bytes read or negative errno */
+	ssize_t			rr_res;
+};
+
+struct read_batch {
+	struct read_req *	rb_reqs;
+	unsigned int		rb_nreqs;
+	unsigned int		rb_size;
+	int			rb_backend;
+
+	/* number of system calls issued, for benchmarking */
+	unsigned long		rb_syscalls;
+
+	void *			rb_ring;
+};
+
+extern int			read_backend_lookup(const char *);
+extern const char *		read_backend_name(int);
+
+extern void			read_batch_init(struct read_batch *, int);
+extern void			read_batch_exit(struct read_batch *);
+
+static inline void read_batch_reset(struct read_batch *rb)
+{
+	rb->rb_nreqs = 0;
+}
+
+extern unsigned int		read_batch_add(struct read_batch *, int,
+					       char *, size_t);
+extern void			read_batch_submit(struct read_batch *);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+ * self.h                 Self Instrumentation
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SELF_H_
+#define __BMON_SELF_H_
+
+#include <bmon/bmon.h>
+
+enum {
+	SELF_READ,		/* input_read() */
+	SELF_EXPIRE,		/* reset_update_flags(), free_unused_elements() */
+	SELF_DRAW,		/* output_draw(), output_post() */
+	SELF_TICK,		/* whole read cycle */
+	SELF_LATENESS,		/* delay of read relative to its deadline */
+	SELF_HISTORY_USED,	/* history arena bytes in use by rings */
+	SELF_HISTORY_ARENA,	/* history arena bytes allocated */
+	SELF_DROPPED,		/* frames dropped by busy output threads */
+	__SELF_MAX,
+};
+
+extern uint64_t			self_clock(void);
+extern void			self_record(int, uint64_t);
+extern void			self_record_timestamp(int, timestamp_t *);
+extern void			self_publish(void);
+
+#endif
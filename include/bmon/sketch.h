@@ -0,0 +1,61 @@
+/*
+ * sketch.h               Quantile Sketch
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef __BMON_SKETCH_H_
+#define __BMON_SKETCH_H_
+
+#include <bmon/bmon.h>
+
+/*
+ * Quantile sketch with relative accuracy (DDSketch). Samples are counted
+ * in logarithmic buckets, a quantile is accurate to within SKETCH_ALPHA
+ * of its value. The buckets cover a range of about 1:28000, if samples
+ * fall below the range the lowest buckets are collapsed so the upper
+ * quantiles stay accurate. Sketches are mergeable and of constant size.
+ */
+#define SKETCH_ALPHA		0.02
+#define SKETCH_BINS		256
+
+struct sketch
+{
+	uint64_t		sk_count;
+	/* samples equal to zero, e.g. rates of an idle link */
+	uint64_t		sk_zero;
+	/* bucket index of sk_bins[0] */
+	int			sk_offset;
+	uint32_t		sk_bins[SKETCH_BINS];
+};
+
+static inline void sketch_reset(struct sketch *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+extern void			sketch_add(struct sketch *, double);
+extern void			sketch_merge(struct sketch *,
+					     const struct sketch *);
+extern int			sketch_quantile(const struct sketch *, double,
+						double *);
+
+#endif
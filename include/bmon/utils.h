@@ -52,7 +52,12 @@ extern void timestamp_sub(timestamp_t *, timestamp_t *, timestamp_t *);
 extern int timestamp_le(timestamp_t *, timestamp_t *);
 extern int timestamp_is_negative(timestamp_t *ts);
 
+extern uint64_t clock_ns(void);
+extern void clock_simulate(void);
+extern void clock_advance(uint64_t);
+
 extern void update_timestamp(timestamp_t *);
+extern void wall_timestamp(timestamp_t *);
 extern void copy_timestamp(timestamp_t *, timestamp_t *);
 
 extern float timestamp_diff(timestamp_t *, timestamp_t *);
@@ -81,6 +81,22 @@ static int default_attr_id(const char *name)
 static LIST_HEAD(attr_def_list);
 static int attr_id_gen = ATTR_MAX + 1;
 
+int attr_demand_restricted;
+unsigned int attr_demand_version = 1;
+
+/* history is collected regardless of demand, see attr_history_always() */
+static int history_always;
+
+/* demand for attributes which have not been defined yet */
+struct demand
+{
+	char *			d_name;
+	int			d_what;
+	struct list_head	d_list;
+};
+
+static LIST_HEAD(demand_list);
+
 struct attr_def *attr_def_lookup(const char *name)
 {
 	struct attr_def *def;
@@ -131,6 +147,7 @@ int attr_def_add(const char *name, const char *desc, struct unit *unit,
 		 int type, int flags)
 {
 	struct attr_def *def;
+	struct demand *d;
 
 #if 0
 	if (flags) {
@@ -162,6 +179,10 @@ int attr_def_add(const char *name, const char *desc, struct unit *unit,
 	}
 #endif
 
+	/* inputs may register the same attribute, share the definition */
+	if ((def = attr_def_lookup(name)))
+		return def->ad_id;
+
 	def = xcalloc(1, sizeof(*def));
 
 	def->ad_id = default_attr_id(name);
@@ -177,12 +198,111 @@ int attr_def_add(const char *name, const char *desc, struct unit *unit,
 
 	list_add_tail(&def->ad_list, &attr_def_list);
 
+	list_for_each_entry(d, &demand_list, d_list) {
+		if (!strcmp(d->d_name, name)) {
+			def->ad_demand = d->d_what;
+			list_del(&d->d_list);
+			xfree(d->d_name);
+			xfree(d);
+			break;
+		}
+	}
+
+	if (history_always && (flags & ATTR_DEF_FLAG_HISTORY))
+		attr_demand_def(def, ATTR_DEMAND_VALUE);
+
 	DBG(1, "[DBG] New attribute %s desc=\"%s\" unit=%s type=%d\n",
 	    def->ad_name, def->ad_description, def->ad_unit->u_name, type);
 
 	return def->ad_id;
 }
 
+/**
+ * Declare demand for an attribute
+ * @arg def		attribute definition
+ * @arg what		ATTR_DEMAND_VALUE and/or ATTR_DEMAND_HISTORY
+ */
+void attr_demand_def(struct attr_def *def, int what)
+{
+	if ((def->ad_demand & what) == what)
+		return;
+
+	def->ad_demand |= what;
+	attr_demand_version++;
+}
+
+/**
+ * Declare demand for an attribute by name
+ * @arg name		name of attribute
+ * @arg what		ATTR_DEMAND_VALUE and/or ATTR_DEMAND_HISTORY
+ *
+ * The attribute does not have to be defined yet, the demand is applied
+ * once an input defines it.
+ */
+void attr_demand(const char *name, int what)
+{
+	struct attr_def *def;
+	struct demand *d;
+
+	if ((def = attr_def_lookup(name))) {
+		attr_demand_def(def, what);
+		return;
+	}
+
+	list_for_each_entry(d, &demand_list, d_list) {
+		if (!strcmp(d->d_name, name)) {
+			d->d_what |= what;
+			return;
+		}
+	}
+
+	d = xcalloc(1, sizeof(*d));
+	d->d_name = strdup(name);
+	d->d_what = what;
+	list_add_tail(&d->d_list, &demand_list);
+}
+
+/**
+ * Declare demand for all defined attributes
+ * @arg what		ATTR_DEMAND_VALUE and/or ATTR_DEMAND_HISTORY
+ */
+void attr_demand_all(int what)
+{
+	struct attr_def *def;
+
+	list_for_each_entry(def, &attr_def_list, ad_list)
+		attr_demand_def(def, what);
+}
+
+/**
+ * Collect history regardless of demand
+ *
+ * Called for history definitions which are always collected. Key
+ * attributes and attributes flagged for history collect history even
+ * if no output declares demand for it.
+ */
+void attr_history_always(void)
+{
+	struct attr_def *def;
+
+	history_always = 1;
+
+	list_for_each_entry(def, &attr_def_list, ad_list)
+		if (def->ad_flags & ATTR_DEF_FLAG_HISTORY)
+			attr_demand_def(def, ATTR_DEMAND_VALUE);
+}
+
+/**
+ * Only collect attributes in demand
+ *
+ * Called if none of the active outputs consumes all attributes.
+ */
+void attr_demand_restrict(void)
+{
+	attr_demand_restricted = 1;
+	attr_demand_version++;
+}
+
 void attr_def_free(struct attr_def *def)
 {
 	if (!def)
@@ -193,27 +313,27 @@ void attr_def_free(struct attr_def *def)
 	xfree(def);
 }
 
-static inline unsigned int attr_hash(int id)
-{
-	return id % ATTR_HASH_SIZE;
-}
-
 struct attr *attr_lookup(const struct element *e, int id)
 {
-	unsigned int hash = attr_hash(id);
-	struct attr *attr;
-
-	list_for_each_entry(attr, &e->e_attrhash[hash], a_list)
-		if (attr->a_def->ad_id == id)
-			return attr;
+	if (id < 0 || id >= e->e_attrs_size || !e->e_attrs[id].a_def)
+		return NULL;
 
-	return NULL;
+	return &e->e_attrs[id];
 }
 
 static int collect_history(struct element *e, struct attr_def *def)
 {
 	int n;
 
+	if (attr_demand_restricted) {
+		/* declared by an output consuming the history of the attribute */
+		if (def->ad_demand & ATTR_DEMAND_HISTORY)
+			return 1;
+
+		if (!history_always)
+			return 0;
+	}
+
 	if (def->ad_flags & ATTR_DEF_FLAG_HISTORY)
 		return 1;
 
@@ -307,15 +427,33 @@ int attr_ignore_overflows(struct attr *a)
 	return a->a_flags & ATTR_FLAG_IGNORE_OVERFLOWS;
 }
 
-void attr_collect_history(struct attr *attr)
+void attr_collect_history(struct element *e, struct attr *attr)
 {
 	if (attr->a_flags & ATTR_FLAG_HISTORY)
 		return;
 
-	history_attach(attr);
+	history_attach(e, attr);
 	attr->a_flags |= ATTR_FLAG_HISTORY;
 }
 
+/**
+ * Declare demand for an attribute of an element
+ * @arg e		element
+ * @arg attr		attribute
+ * @arg what		ATTR_DEMAND_VALUE and/or ATTR_DEMAND_HISTORY
+ *
+ * Like attr_demand_def() but the attribute starts collecting history
+ * right away if it already exists without.
+ */
+void attr_demand_attr(struct element *e, struct attr *attr, int what)
+{
+	attr_demand_def(attr->a_def, what);
+
+	if (!(attr->a_flags & ATTR_FLAG_HISTORY) &&
+	    collect_history(e, attr->a_def))
+		attr_collect_history(e, attr);
+}
+
 int attrcmp(struct element *e, struct attr *a, struct attr *b)
 {
 	/* major key attribute is always first */
@@ -334,60 +472,214 @@ int attrcmp(struct element *e, struct attr *a, struct attr *b)
 	return strcasecmp(a->a_def->ad_description, b->a_def->ad_description);
 }
 
-void attr_update(struct element *e, int id, uint64_t rx, uint64_t tx, int flags)
+static void attr_sort_insert(struct element *e, struct attr *attr)
 {
-	struct attr *attr, *n;
-	int update_ts = 0;
+	struct attr *n;
 
-	if (!(attr = attr_lookup(e, id))) {
-		unsigned int hash = attr_hash(id);
-		struct attr_def *def;
-
-		if (!(def = attr_def_lookup_id(id)))
+	list_for_each_entry(n, &e->e_attr_sorted, a_sort_list) {
+		if (attrcmp(e, attr, n) < 0) {
+			list_add_tail(&attr->a_sort_list, &n->a_sort_list);
 			return;
+		}
+	}
 
-		attr = xcalloc(1, sizeof(*attr));
-		attr->a_def = def;
-		attr->a_flags = def->ad_flags;
+	list_add_tail(&attr->a_sort_list, &e->e_attr_sorted);
+}
 
-		init_list_head(&attr->a_history_list);
+/*
+ * Moving the attribute array invalidates all list heads embedded in
+ * the attributes. The sort list is rebuilt and the history lists are
+ * relinked to the new location of their heads.
+ */
+static void attr_array_resize(struct element *e, unsigned int size)
+{
+	struct attr *old = e->e_attrs, *a;
+	unsigned int i;
 
-		if (collect_history(e, def))
-			attr_collect_history(attr);
+	e->e_attrs = xcalloc(size, sizeof(struct attr));
+	memcpy(e->e_attrs, old, e->e_attrs_size * sizeof(struct attr));
 
-		list_add_tail(&attr->a_list, &e->e_attrhash[hash]);
-		e->e_nattrs++;
+	init_list_head(&e->e_attr_sorted);
 
-		list_for_each_entry(n, &e->e_attr_sorted, a_sort_list) {
-			if (attrcmp(e, attr, n) < 0) {
-				list_add_tail(&attr->a_sort_list,
-					      &n->a_sort_list);
-				goto inserted;
-			}
+	for (i = 0; i < e->e_attrs_size; i++) {
+		struct list_head *head;
+
+		a = &e->e_attrs[i];
+		if (!a->a_def)
+			continue;
+
+		head = &a->a_history_list;
+		if (head->next == &old[i].a_history_list)
+			init_list_head(head);
+		else {
+			head->next->prev = head;
+			head->prev->next = head;
 		}
 
-		list_add_tail(&attr->a_sort_list, &e->e_attr_sorted);
+		attr_sort_insert(e, a);
+	}
+
+	if (e->e_current_attr)
+		e->e_current_attr = &e->e_attrs[e->e_current_attr - old];
+
+	e->e_attrs_size = size;
+	xfree(old);
+}
+
+static void attr_init(struct element *e, struct attr *attr,
+		      struct attr_def *def)
+{
+	attr->a_def = def;
+	attr->a_flags = def->ad_flags;
+
+	init_list_head(&attr->a_history_list);
+
+	if (collect_history(e, def))
+		attr_collect_history(e, attr);
+
+	e->e_nattrs++;
+
+	attr_sort_insert(e, attr);
+}
+
+/* grow in steps to avoid resizing for every new attribute */
+static inline void attr_array_reserve(struct element *e, int id)
+{
+	if (id >= e->e_attrs_size)
+		attr_array_resize(e, (id + 8) & ~7);
+}
+
+void attr_update(struct element *e, int id, uint64_t rx, uint64_t tx, int flags)
+{
+	struct attr *attr;
+
+	if (!(attr = attr_lookup(e, id))) {
+		struct attr_def *def;
+
+		if (!(def = attr_def_lookup_id(id)) ||
+		    !attr_def_demanded(def, ATTR_DEMAND_VALUE))
+			return;
+
+		attr_array_reserve(e, id);
+
+		attr = &e->e_attrs[id];
+		attr_init(e, attr, def);
 	}
 
-inserted:
 	if (flags & UPDATE_FLAG_RX) {
 		attr->a_rx_rate.r_current = rx;
 		attr->a_flags |= ATTR_FLAG_RX_ENABLED;
-		update_ts = 1;
 	}
 
 	if (flags & UPDATE_FLAG_TX) {
 		attr->a_tx_rate.r_current = tx;
 		attr->a_flags |= ATTR_FLAG_TX_ENABLED;
-		update_ts = 1;
 	}
 
-	if (update_ts)
-		update_timestamp(&attr->a_last_update);
-
 	DBG(2, "Updated attribute %d of element %s\n", id, e->e_name);
 }
 
+/**
+ * Add attribute to batch
+ * @arg b		attribute batch
+ * @arg id		attribute id
+ * @arg flags		UPDATE_FLAG_RX and/or UPDATE_FLAG_TX
+ *
+ * Entries are used in the order they have been added, the values
+ * passed to attr_update_batch() must be in the same order. An unknown
+ * attribute id still occupies an entry but is never updated.
+ *
+ * @return Index of entry
+ */
+int attr_batch_add(struct attr_batch *b, int id, int flags)
+{
+	struct attr_batch_entry *be;
+
+	if (b->ab_nentries >= ATTR_BATCH_MAX)
+		BUG();
+
+	be = &b->ab_entries[b->ab_nentries];
+	be->be_def = attr_def_lookup_id(id);
+	be->be_flags = flags;
+
+	if (be->be_def && id > b->ab_max_id)
+		b->ab_max_id = id;
+
+	return b->ab_nentries++;
+}
+
+/**
+ * Entries of batch in demand
+ * @arg b		attribute batch
+ *
+ * Inputs may use the returned mask to avoid fetching values nobody
+ * consumes. The mask is only recalculated if the demand has changed.
+ *
+ * @return Bitmask of entries in demand.
+ */
+uint64_t attr_batch_demand(struct attr_batch *b)
+{
+	unsigned int i;
+
+	if (b->ab_demand_version == attr_demand_version)
+		return b->ab_demand;
+
+	b->ab_demand = 0;
+	for (i = 0; i < b->ab_nentries; i++) {
+		struct attr_def *def = b->ab_entries[i].be_def;
+
+		if (def && attr_def_demanded(def, ATTR_DEMAND_VALUE))
+			b->ab_demand |= 1ULL << i;
+	}
+
+	b->ab_demand_version = attr_demand_version;
+
+	return b->ab_demand;
+}
+
+/**
+ * Update attributes of an element from a vector of values
+ * @arg e		element
+ * @arg b		attribute batch describing the vector
+ * @arg rx		RX values, may be NULL if no entry has RX values
+ * @arg tx		TX values, may be NULL if no entry has TX values
+ * @arg mask		bitmask of entries to update, e.g. ATTR_BATCH_ALL
+ *
+ * Entries not in demand are skipped, see attr_batch_demand().
+ */
+void attr_update_batch(struct element *e, struct attr_batch *b,
+		       const uint64_t *rx, const uint64_t *tx, uint64_t mask)
+{
+	unsigned int i;
+
+	mask &= attr_batch_demand(b);
+
+	/* resize once so the loop below can index the array directly */
+	attr_array_reserve(e, b->ab_max_id);
+
+	for (i = 0; i < b->ab_nentries; i++) {
+		struct attr_batch_entry *be = &b->ab_entries[i];
+		struct attr *attr;
+
+		if (!(mask & (1ULL << i)) || !be->be_def)
+			continue;
+
+		attr = &e->e_attrs[be->be_def->ad_id];
+		if (!attr->a_def)
+			attr_init(e, attr, be->be_def);
+
+		if (be->be_flags & UPDATE_FLAG_RX) {
+			attr->a_rx_rate.r_current = rx[i];
+			attr->a_flags |= ATTR_FLAG_RX_ENABLED;
+		}
+
+		if (be->be_flags & UPDATE_FLAG_TX) {
+			attr->a_tx_rate.r_current = tx[i];
+			attr->a_flags |= ATTR_FLAG_TX_ENABLED;
+		}
+	}
+}
+
 void attr_free(struct attr *a)
 {
 	struct history *h, *n;
@@ -395,9 +687,8 @@ void attr_free(struct attr *a)
 	list_for_each_entry_safe(h, n, &a->a_history_list, h_list)
 		history_free(h);
 
-	list_del(&a->a_list);
-
-	xfree(a);
+	list_del(&a->a_sort_list);
+	a->a_def = NULL;
 }
 
 void attr_rate2float(struct attr *a, double *rx, char **rxu, int *rxprec,
@@ -638,12 +929,12 @@ static void calc_counter_rate(struct attr *a, struct rate *rate,
 
 	old_rate = rate->r_rate;
 
-	if (rate->r_total < prev_total) {
+	if (rate->r_total < rate->r_calc_total) {
 		/* overflow */
-		delta = 0xFFFFFFFFFFFFFFFFULL - prev_total;
+		delta = 0xFFFFFFFFFFFFFFFFULL - rate->r_calc_total;
 		delta += rate->r_total + 1;
 	} else
-		delta = rate->r_total - prev_total;
+		delta = rate->r_total - rate->r_calc_total;
 
 	rate->r_rate = delta / diff;
 
@@ -651,6 +942,7 @@ static void calc_counter_rate(struct attr *a, struct rate *rate,
 		rate->r_rate = ((rate->r_rate * 3.0f) + old_rate) / 4.0f;
 
 out:
+	rate->r_calc_total = rate->r_total;
 	copy_timestamp(&rate->r_last_calc, ts);
 }
 
@@ -661,7 +953,7 @@ static void calc_rate_total(struct attr *a, struct rate *rate, timestamp_t *ts)
 	copy_timestamp(&rate->r_last_calc, ts);
 }
 
-void attr_notify_update(struct attr *a, timestamp_t *ts)
+void attr_notify_update(struct element *e, struct attr *a, timestamp_t *ts)
 {
 	switch (a->a_def->ad_type) {
 	case ATTR_TYPE_RATE:
@@ -683,6 +975,9 @@ void attr_notify_update(struct attr *a, timestamp_t *ts)
 	if (a->a_flags & ATTR_FLAG_HISTORY) {
 		struct history *h;
 
+		if (a->a_history_version != history_view_version)
+			history_attach(e, a);
+
 		list_for_each_entry(h, &a->a_history_list, h_list)
 			history_update(a, h, ts);
 	}
@@ -691,7 +986,13 @@ void attr_notify_update(struct attr *a, timestamp_t *ts)
 static void __exit attr_exit(void)
 {
 	struct attr_def *ad, *n;
+	struct demand *d, *dn;
 
 	list_for_each_entry_safe(ad, n, &attr_def_list, ad_list)
 		attr_def_free(ad);
+
+	list_for_each_entry_safe(d, dn, &demand_list, d_list) {
+		xfree(d->d_name);
+		xfree(d);
+	}
 }
@@ -0,0 +1,336 @@
+/*
+ * bench_pipeline.c     Pipeline Benchmark
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Drives the complete read cycle (input, rate calculation, history,
+ * expiry and output) with the dummy input at various element counts
+ * and reports the time spent per phase and the peak RSS. Every
+ * scenario runs in its own process so memory and module state do not
+ * carry over.
+ *
+ * Output modules write to /dev/null, curses is drawn offscreen. The
+ * reads are performed back to back on a simulated clock which advances
+ * by the read interval on each read, so rates and history behave as in
+ * a real run of the same length.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/input.h>
+#include <bmon/output.h>
+#include <bmon/module.h>
+#include <bmon/group.h>
+#include <bmon/attr.h>
+#include <bmon/history.h>
+#include <bmon/utils.h>
+#include <sys/resource.h>
+
+static const char *c_counts = "1000,10000,100000";
+static const char *c_outputs = "null,format,curses";
+static const char *c_configfile;
+static const char *c_history = "minute";
+static unsigned int c_ticks = 20;
+static float c_interval = 1.0f;
+static int c_depth = 0;
+static int c_children = 4;
+static int c_attrs = 2;
+
+static FILE *report;
+
+int do_quit;
+
+void quit(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+
+	exit(1);
+}
+
+void xwarn(const char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+enum {
+	PHASE_READ,
+	PHASE_EXPIRE,
+	PHASE_DRAW,
+	PHASE_TOTAL,
+	__PHASE_MAX,
+};
+
+static void tick(uint64_t *ns)
+{
+	uint64_t t0, t1, t2, t3, t4;
+
+	clock_advance(c_interval * 1000000000.0f);
+	update_timestamp(&rtiming.rt_last_read);
+
+	t0 = now_ns();
+	reset_update_flags();
+
+	t1 = now_ns();
+	input_read();
+
+	t2 = now_ns();
+	free_unused_elements();
+
+	t3 = now_ns();
+	output_draw();
+	output_post();
+
+	t4 = now_ns();
+
+	ns[PHASE_READ] += t2 - t1;
+	ns[PHASE_EXPIRE] += (t1 - t0) + (t3 - t2);
+	ns[PHASE_DRAW] += t4 - t3;
+	ns[PHASE_TOTAL] += t4 - t0;
+}
+
+static void count_element(struct element_group *g, struct element *e,
+			  void *arg)
+{
+	(*(unsigned int *) arg)++;
+}
+
+static void default_history(void)
+{
+	struct history_def *def;
+
+	def = history_def_alloc("second");
+	def->hd_interval = 1.0f;
+	def->hd_size = 60;
+	def->hd_type = HISTORY_TYPE_64;
+
+	def = history_def_alloc("minute");
+	def->hd_interval = 60.0f;
+	def->hd_size = 60;
+	def->hd_type = HISTORY_TYPE_64;
+}
+
+static const char *output_param(const char *name)
+{
+	if (!strcmp(name, "format"))
+		return "format:fmt=$(element:name) $(attr:rxrate:bytes) " \
+		       "$(attr:txrate:bytes) $(attr:rxrate:packets) " \
+		       "$(attr:txrate:packets)\\n";
+
+	return name;
+}
+
+static void run_scenario(unsigned int count, const char *output)
+{
+	uint64_t create = 0, ns[__PHASE_MAX] = {0};
+	unsigned int i, per_dev = 1, level = 1, numdev, n = 0;
+	char input[128];
+	struct history_usage usage;
+	struct rusage ru;
+	int devnull;
+
+	for (i = 0; i < c_depth; i++) {
+		level *= c_children;
+		per_dev += level;
+	}
+
+	numdev = (count + per_dev - 1) / per_dev;
+
+	snprintf(input, sizeof(input),
+		 "dummy:num=%u;numgroups=1;depth=%d;children=%d;attrs=%d",
+		 numdev, c_depth, c_children, c_attrs);
+
+	if (c_configfile) {
+		set_configfile(c_configfile);
+		configfile_read();
+	} else
+		default_history();
+
+	cfg_setbool(cfg, "show_all", cfg_true);
+	cfg_setfloat(cfg, "read_interval", c_interval);
+	input_set(input);
+	output_set(output_param(output));
+
+	/* everything drawn by the outputs is discarded */
+	if ((devnull = open("/dev/null", O_WRONLY)) < 0 ||
+	    dup2(devnull, STDOUT_FILENO) < 0)
+		quit("Unable to redirect output: %s\n", strerror(errno));
+
+	setenv("TERM", "xterm", 0);
+	setenv("LINES", "50", 0);
+	setenv("COLUMNS", "160", 0);
+
+	conf_init();
+	module_init();
+
+	/* collect the history of the key attributes as if displayed */
+	if (*c_history) {
+		struct history_def *def;
+
+		if (!(def = history_def_lookup(c_history)))
+			quit("Unknown history definition %s\n", c_history);
+
+		history_def_view(def);
+		attr_demand("bytes", ATTR_DEMAND_VALUE | ATTR_DEMAND_HISTORY);
+		attr_demand("packets", ATTR_DEMAND_VALUE | ATTR_DEMAND_HISTORY);
+	}
+
+	clock_simulate();
+	update_timestamp(&rtiming.rt_last_read);
+
+	/* the first read creates all elements */
+	create = now_ns();
+	input_read();
+	create = now_ns() - create;
+
+	for (i = 0; i < c_ticks; i++)
+		tick(ns);
+
+	group_foreach_recursive(count_element, &n);
+	history_usage(&usage);
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(report, "%-8s %8u %10.2f %12" PRIu64 " %12" PRIu64 " %12"
+		PRIu64 " %12" PRIu64 " %10ld %10zu\n",
+		output, n, create / 1000000.0,
+		ns[PHASE_READ] / c_ticks,
+		ns[PHASE_EXPIRE] / c_ticks,
+		ns[PHASE_DRAW] / c_ticks,
+		ns[PHASE_TOTAL] / c_ticks,
+		ru.ru_maxrss, usage.hu_reserved / 1024);
+	fflush(report);
+}
+
+static void run(unsigned int count, const char *output)
+{
+	pid_t pid;
+	int status;
+
+	fflush(report);
+
+	if ((pid = fork()) < 0)
+		quit("fork() failed: %s\n", strerror(errno));
+
+	if (pid == 0) {
+		run_scenario(count, output);
+		_exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+	    WEXITSTATUS(status))
+		fprintf(report, "%-8s %8u failed\n", output, count);
+}
+
+static void print_usage(void)
+{
+	printf(
+	"Usage: bench_pipeline [OPTION]...\n" \
+	"\n" \
+	"Options:\n" \
+	"   -n LIST     Number of elements per scenario (default: %s)\n" \
+	"   -o LIST     Output modules (default: %s)\n" \
+	"   -t NUM      Number of reads per scenario (default: %u)\n" \
+	"   -r FLOAT    Simulated read interval in seconds (default: %.1f)\n" \
+	"   -d NUM      Levels of child elements (default: %d)\n" \
+	"   -c NUM      Number of children per element (default: %d)\n" \
+	"   -a NUM      Number of attributes per element (default: %d)\n" \
+	"   -f PATH     Configuration file (default: built-in history)\n" \
+	"   -H NAME     History definition to collect, \"\" for none " \
+	"(default: %s)\n" \
+	"\n" \
+	"Times are per read in nanoseconds, RSS and history arena in KiB.\n",
+	c_counts, c_outputs, c_ticks, c_interval, c_depth, c_children, c_attrs,
+	c_history);
+}
+
+int main(int argc, char *argv[])
+{
+	char *counts, *outputs, *c, *o, *save1, *save2;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:o:t:r:d:c:a:f:H:h")) != -1) {
+		switch (opt) {
+		case 'n': c_counts = optarg; break;
+		case 'o': c_outputs = optarg; break;
+		case 't': c_ticks = strtoul(optarg, NULL, 0); break;
+		case 'r': c_interval = strtod(optarg, NULL); break;
+		case 'd': c_depth = strtol(optarg, NULL, 0); break;
+		case 'c': c_children = strtol(optarg, NULL, 0); break;
+		case 'a': c_attrs = strtol(optarg, NULL, 0); break;
+		case 'f': c_configfile = optarg; break;
+		case 'H': c_history = optarg; break;
+		default:
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (!c_ticks || c_interval <= 0.0f || c_depth < 0 || c_children < 1) {
+		print_usage();
+		return 1;
+	}
+
+	/* scenarios redirect stdout to /dev/null, keep a copy for results */
+	if (!(report = fdopen(dup(STDOUT_FILENO), "w")))
+		quit("Unable to duplicate stdout: %s\n", strerror(errno));
+
+	fprintf(report, "%u reads every %.2fs, depth %d, %d children, " \
+		"%d attributes\n\n", c_ticks, c_interval, c_depth, c_children,
+		c_attrs);
+	fprintf(report, "%-8s %8s %10s %12s %12s %12s %12s %10s %10s\n",
+		"output", "elements", "create ms", "read ns", "expire ns",
+		"draw ns", "total ns", "maxrss", "history");
+
+	counts = strdup(c_counts);
+
+	for (c = strtok_r(counts, ",", &save1); c;
+	     c = strtok_r(NULL, ",", &save1)) {
+		outputs = strdup(c_outputs);
+
+		for (o = strtok_r(outputs, ",", &save2); o;
+		     o = strtok_r(NULL, ",", &save2))
+			run(strtoul(c, NULL, 0), o);
+
+		xfree(outputs);
+	}
+
+	xfree(counts);
+
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * bench_read.c         Read Backend Benchmark
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Compares the read backends by reading a set of files once per tick,
+ * the way the sysfs input does. By default all interface statistic
+ * files in /sys/class/net are read.
+ *
+ * Usage: bench_read [-t TICKS] [FILE...]
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/readbatch.h>
+#include <bmon/utils.h>
+
+#define BUFSIZE 32
+
+static int *fds;
+static char *bufs;
+static unsigned int nfds;
+
+static void add_file(const char *path)
+{
+	int fd;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+		fprintf(stderr, "%s: %s\n", path, strerror(errno));
+		return;
+	}
+
+	fds = xrealloc(fds, (nfds + 1) * sizeof(int));
+	fds[nfds++] = fd;
+}
+
+static void add_sysfs_files(void)
+{
+	char dir[FILENAME_MAX], path[FILENAME_MAX];
+	struct dirent *de, *se;
+	DIR *d, *s;
+
+	if (!(d = opendir("/sys/class/net")))
+		return;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		snprintf(dir, sizeof(dir), "/sys/class/net/%s/statistics",
+			 de->d_name);
+
+		if (!(s = opendir(dir)))
+			continue;
+
+		while ((se = readdir(s))) {
+			if (se->d_name[0] == '.')
+				continue;
+
+			snprintf(path, sizeof(path),
+				 "/sys/class/net/%s/statistics/%s",
+				 de->d_name, se->d_name);
+			add_file(path);
+		}
+
+		closedir(s);
+	}
+
+	closedir(d);
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void run(int backend, unsigned int ticks)
+{
+	struct read_batch rb;
+	unsigned int t, i, errors = 0;
+	uint64_t start, elapsed;
+
+	read_batch_init(&rb, backend);
+
+	if (rb.rb_backend != backend) {
+		printf("%-10s unavailable\n", read_backend_name(backend));
+		read_batch_exit(&rb);
+		return;
+	}
+
+	start = now_ns();
+
+	for (t = 0; t < ticks; t++) {
+		read_batch_reset(&rb);
+
+		for (i = 0; i < nfds; i++)
+			read_batch_add(&rb, fds[i], bufs + i * BUFSIZE,
+				       BUFSIZE);
+
+		read_batch_submit(&rb);
+
+		for (i = 0; i < nfds; i++)
+			if (rb.rb_reqs[i].rr_res < 0)
+				errors++;
+	}
+
+	elapsed = now_ns() - start;
+
+	/* the backend may have fallen back during the run */
+	printf("%-10s %10.1f %14.1f %10.1f %8u\n",
+	       read_backend_name(rb.rb_backend),
+	       (double) elapsed / ticks / 1000.0,
+	       (double) elapsed / ticks / nfds,
+	       (double) rb.rb_syscalls / ticks, errors);
+
+	read_batch_exit(&rb);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int ticks = 1000;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-t") && i + 1 < argc)
+			ticks = strtoul(argv[++i], NULL, 0);
+		else
+			add_file(argv[i]);
+	}
+
+	if (!nfds)
+		add_sysfs_files();
+
+	if (!nfds || !ticks) {
+		fprintf(stderr, "Usage: bench_read [-t TICKS] [FILE...]\n");
+		return 1;
+	}
+
+	bufs = xcalloc(nfds, BUFSIZE);
+
+	printf("%u files, %u ticks\n\n", nfds, ticks);
+	printf("%-10s %10s %14s %10s %8s\n",
+	       "backend", "us/tick", "ns/file", "calls/tick", "errors");
+
+	run(READ_BACKEND_PREAD, ticks);
+	run(READ_BACKEND_URING, ticks);
+
+	return 0;
+}
@@ -30,6 +30,8 @@
 #include <bmon/module.h>
 #include <bmon/group.h>
 #include <bmon/signal.h>
+#include <bmon/self.h>
+#include <bmon/history.h>
 
 int start_time;
 int do_quit = 0;
@@ -88,6 +90,7 @@ static void do_shutdown(void)
 	
 	if (!done) {
 		done = 1;
+		output_stop();
 		module_shutdown();
 		conf_shutdown();
 	}
@@ -283,7 +286,7 @@ static void parse_args_post(int argc, char *argv[])
 				break;
 
 			case 'L':
-				cfg_setint(cfg, "lifetime", strtoul(optarg, NULL, 0));
+				cfg_setfloat(cfg, "lifetime", strtod(optarg, NULL));
 				break;
 
 			case 'g':
@@ -302,10 +305,13 @@ static void parse_args_post(int argc, char *argv[])
 	}
 }
 
-#if 0
+/*
+ * Record how late a read was performed relative to its deadline, in
+ * percent of the read interval.
+ */
 static void calc_variance(timestamp_t *c, timestamp_t *ri)
 {
-	float v = (ts_to_float(c) / ts_to_float(ri)) * 100.0f;
+	float v = (timestamp_to_float(c) / timestamp_to_float(ri)) * 100.0f;
 
 	rtiming.rt_variance.v_error = v;
 	rtiming.rt_variance.v_total += v;
@@ -315,8 +321,9 @@ static void calc_variance(timestamp_t *c, timestamp_t *ri)
 
 	if (v < rtiming.rt_variance.v_min)
 		rtiming.rt_variance.v_min = v;
+
+	self_record_timestamp(SELF_LATENESS, c);
 }
-#endif
 
 static void drop_privs(void)
 {
@@ -404,133 +411,288 @@ static void init_syslog(void)
 	openlog("bmon", LOG_CONS | LOG_PID, LOG_DAEMON);
 }
 
-int main(int argc, char *argv[])
+static void do_read(void)
 {
-	unsigned long sleep_time;
-	double read_interval;
-	
+	uint64_t start, t1, t2, t3, t4;
 
-	start_time = time(0);
+	rtiming.rt_reads++;
 
-	parse_args_pre(argc, argv);
-	configfile_read();
-	parse_args_post(argc, argv);
+	start = self_clock();
+	reset_update_flags();
+	self_publish();
 
-	conf_init();
-	module_init();
+	t1 = self_clock();
+	input_read();
 
-	read_interval = cfg_read_interval;
-	sleep_time = cfg_getint(cfg, "sleep_time");
+	t2 = self_clock();
+	free_unused_elements();
+	history_file_sync(0);
 
-	if (((double) sleep_time / 1000000.0f) > read_interval)
-		sleep_time = (unsigned long) (read_interval * 1000000.0f);
+	t3 = self_clock();
+	output_draw();
+	output_post();
 
-	// pipe_start();
+	t4 = self_clock();
 
-	if (cfg_getbool(cfg, "daemon")) {
-		init_syslog();
-		daemonize();
-		write_pidfile();
-	}
+	self_record(SELF_READ, t2 - t1);
+	self_record(SELF_EXPIRE, (t1 - start) + (t3 - t2));
+	self_record(SELF_DRAW, t4 - t3);
+	self_record(SELF_TICK, t4 - start);
+}
 
-	drop_privs();
+static void mainloop_poll(double read_interval, unsigned long sleep_time)
+{
+	/*
+	 * E  := Elapsed time
+	 * NR := Next Read
+	 * LR := Last Read
+	 * RI := Read Interval
+	 * ST := Sleep Time
+	 * C  := Correction
+	 */
+	timestamp_t e, ri, tmp;
+	unsigned long st;
+
+	float_to_timestamp(&ri, read_interval);
+
+	/*
+	 * NR := NOW
+	 */
+	update_timestamp(&rtiming.rt_next_read);
+	
+	for (;;) {
+		rtiming.rt_wakeups++;
+
+		output_pre();
 
-	do {
 		/*
-		 * E  := Elapsed time
-		 * NR := Next Read
-		 * LR := Last Read
-		 * RI := Read Interval
-		 * ST := Sleep Time
-		 * C  := Correction
+		 * E := NOW
 		 */
-		timestamp_t e, ri, tmp;
-		unsigned long st;
-
-		float_to_timestamp(&ri, read_interval);
+		update_timestamp(&e);
 
 		/*
-		 * NR := NOW
+		 * IF NR <= E THEN
 		 */
-		update_timestamp(&rtiming.rt_next_read);
-		
-		for (;;) {
-			output_pre();
+		if (timestamp_le(&rtiming.rt_next_read, &e)) {
+			timestamp_t c, late;
 
 			/*
-			 * read the chucka chucka pipe
+			 * C :=  (NR - E)
 			 */
-			// pipe_handle();
+			timestamp_sub(&c, &rtiming.rt_next_read, &e);
+			timestamp_sub(&late, &e, &rtiming.rt_next_read);
+
+			calc_variance(&late, &ri);
 
 			/*
-			 * E := NOW
+			 * LR := E
 			 */
-			update_timestamp(&e);
+			copy_timestamp(&rtiming.rt_last_read, &e);
 
 			/*
-			 * IF NR <= E THEN
+			 * NR := E + RI + C
 			 */
-			if (timestamp_le(&rtiming.rt_next_read, &e)) {
-				timestamp_t c;
-
-				/*
-				 * C :=  (NR - E)
-				 */
-				timestamp_sub(&c, &rtiming.rt_next_read, &e);
-
-				//calc_variance(&c, &ri);
+			timestamp_add(&rtiming.rt_next_read, &e, &ri);
+			timestamp_add(&rtiming.rt_next_read,
+			       &rtiming.rt_next_read, &c);
 
-				/*
-				 * LR := E
-				 */
-				copy_timestamp(&rtiming.rt_last_read, &e);
+			do_read();
+		}
 
-				/*
-				 * NR := E + RI + C
-				 */
-				timestamp_add(&rtiming.rt_next_read, &e, &ri);
-				timestamp_add(&rtiming.rt_next_read,
-				       &rtiming.rt_next_read, &c);
+		if (do_quit)
+			exit(0);
 
+		/*
+		 * ST := Configured ST
+		 */
+		st = sleep_time;
 
-				reset_update_flags();
-				input_read();
-				free_unused_elements();
-				output_draw();
-				output_post();
-			}
+		/*
+		 * IF (NR - E) < ST THEN
+		 */
+		timestamp_sub(&tmp, &rtiming.rt_next_read, &e);
 
-			if (do_quit)
-				exit(0);
+		if (tmp.tv_sec < 0)
+			continue;
 
+		if (tmp.tv_sec == 0 && tmp.tv_usec < st) {
+			if (tmp.tv_usec < 0)
+				continue;
 			/*
-			 * ST := Configured ST
+			 * ST := (NR - E)
 			 */
-			st = sleep_time;
+			st = tmp.tv_usec;
+		}
+		
+		/*
+		 * SLEEP(ST)
+		 */
+		usleep(st);
+	}
+}
+
+#ifdef HAVE_EVENT_LOOP
+static int arm_timer(int fd, timestamp_t *deadline)
+{
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec = deadline->tv_sec,
+			.tv_nsec = deadline->tv_usec * 1000,
+		},
+	};
+
+	return timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static int add_fd(int epfd, int fd)
+{
+	struct epoll_event ev = {
+		.events = EPOLLIN,
+		.data.fd = fd,
+	};
+
+	return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+/*
+ * Sleeps until the next read deadline or until an interactive output
+ * module has user input pending. The deadlines are kept on the
+ * monotonic clock so the schedule is unaffected by changes to the
+ * wall clock. The timer is armed with timestamps from the clock source,
+ * which therefore must not be simulated.
+ *
+ * Returns a negative error code if the event loop could not be set up,
+ * the caller is expected to fall back to mainloop_poll() in that case.
+ */
+static int mainloop_event(double read_interval)
+{
+	struct epoll_event events[2];
+	timestamp_t ri, now, late;
+	uint64_t expirations;
+	int epfd, tfd, n, i;
+
+	if ((tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)) < 0)
+		return -errno;
+
+	if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		close(tfd);
+		return -errno;
+	}
+
+	if (add_fd(epfd, tfd) < 0)
+		goto errout;
+
+	if (output_is_interactive() && add_fd(epfd, STDIN_FILENO) < 0)
+		goto errout;
+
+	float_to_timestamp(&ri, read_interval);
+
+	/* first read is due immediately */
+	update_timestamp(&rtiming.rt_next_read);
+
+	for (;;) {
+		if (arm_timer(tfd, &rtiming.rt_next_read) < 0)
+			quit("Unable to arm read timer: %s\n", strerror(errno));
+
+		n = epoll_wait(epfd, events, ARRAY_SIZE(events), -1);
+		rtiming.rt_wakeups++;
+
+		if (n < 0) {
+			if (errno != EINTR)
+				quit("epoll_wait() failed: %s\n",
+				     strerror(errno));
 
 			/*
-			 * IF (NR - E) < ST THEN
+			 * Interrupted by a signal, give interactive outputs
+			 * a chance to react to e.g. a window resize.
 			 */
-			timestamp_sub(&tmp, &rtiming.rt_next_read, &e);
+			output_pre();
+		}
 
-			if (tmp.tv_sec < 0)
+		for (i = 0; i < n; i++) {
+			if (events[i].data.fd == STDIN_FILENO) {
+				output_pre();
 				continue;
-
-			if (tmp.tv_sec == 0 && tmp.tv_usec < st) {
-				if (tmp.tv_usec < 0)
-					continue;
-				/*
-				 * ST := (NR - E)
-				 */
-				st = tmp.tv_usec;
 			}
-			
+
+			if (read(tfd, &expirations, sizeof(expirations)) < 0)
+				continue;
+
+			update_timestamp(&now);
+			timestamp_sub(&late, &now, &rtiming.rt_next_read);
+			calc_variance(&late, &ri);
+
+			copy_timestamp(&rtiming.rt_last_read, &now);
+
+			do_read();
+
 			/*
-			 * SLEEP(ST)
+			 * Stick to the original schedule but skip all
+			 * deadlines which have already passed.
 			 */
-			usleep(st);
+			do {
+				timestamp_add(&rtiming.rt_next_read,
+					      &rtiming.rt_next_read, &ri);
+			} while (timestamp_le(&rtiming.rt_next_read, &now));
 		}
-	} while (0);
+
+		if (do_quit)
+			exit(0);
+	}
+
+	/* not reached */
+
+errout:
+	n = -errno;
+	close(epfd);
+	close(tfd);
+
+	return n;
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	unsigned long sleep_time;
+	double read_interval;
+#ifdef HAVE_EVENT_LOOP
+	int err;
+#endif
+
+	start_time = time(0);
+
+	parse_args_pre(argc, argv);
+	configfile_read();
+	parse_args_post(argc, argv);
+
+	conf_init();
+	module_init();
+
+	read_interval = cfg_read_interval;
+	sleep_time = cfg_getint(cfg, "sleep_time");
+
+	if (((double) sleep_time / 1000000.0f) > read_interval)
+		sleep_time = (unsigned long) (read_interval * 1000000.0f);
+
+	// pipe_start();
+
+	if (cfg_getbool(cfg, "daemon")) {
+		init_syslog();
+		daemonize();
+		write_pidfile();
+	}
+
+	drop_privs();
+	output_start();
+
+#ifdef HAVE_EVENT_LOOP
+	if ((err = mainloop_event(read_interval)) < 0) {
+		xwarn("Event loop unavailable (%s), falling back to "
+		      "polling\n", strerror(-err));
+	}
+#endif
+
+	mainloop_poll(read_interval, sleep_time);
 
 	return 0; /* buddha says i'll never be reached */
 }
@@ -539,4 +701,5 @@ static void __init bmon_init(void)
 {
 	atexit(&sig_exit);
 	signal(SIGINT, &sig_int);
+	signal(SIGTERM, &sig_int);
 }
@@ -22,17 +22,13 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
-/*
- * TODO
- *  - cache lifecycles
- */
-
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
 #include <bmon/unit.h>
 #include <bmon/attr.h>
 #include <bmon/element.h>
 #include <bmon/element_cfg.h>
+#include <bmon/policy.h>
 #include <bmon/history.h>
 #include <bmon/utils.h>
 
@@ -51,6 +47,8 @@ static cfg_opt_t history_opts[] = {
 	CFG_FLOAT("interval", 1.0f, CFGF_NONE),
 	CFG_INT("size", 60, CFGF_NONE),
 	CFG_STR("type", "64bit", CFGF_NONE),
+	CFG_BOOL("always", cfg_false, CFGF_NONE),
+	CFG_BOOL("quantiles", cfg_false, CFGF_NONE),
 	CFG_END()
 };
 
@@ -84,21 +82,28 @@ static cfg_opt_t global_opts[] = {
 	CFG_INT("sleep_time", 20000UL, CFGF_NONE),
 	CFG_BOOL("use_si", 0, CFGF_NONE),
 	CFG_BOOL("daemon", 0, CFGF_NONE),
+	CFG_BOOL("self_stats", 0, CFGF_NONE),
+	CFG_BOOL("output_threads", cfg_true, CFGF_NONE),
 	CFG_STR("uid", NULL, CFGF_NONE),
 	CFG_STR("gid", NULL, CFGF_NONE),
 	CFG_STR("pidfile", "/var/run/bmon.pid", CFGF_NONE),
 	CFG_INT("signal_driven", 0, CFGF_NONE),
 	CFG_STR("policy", "", CFGF_NONE),
+	CFG_STR("history_file", "", CFGF_NONE),
+	CFG_INT("history_file_size", 16, CFGF_NONE),
+	CFG_FLOAT("history_sync", 60.0f, CFGF_NONE),
 	CFG_SEC("unit", unit_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_SEC("attr", attr_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_SEC("history", history_opts, CFGF_MULTI | CFGF_TITLE),
 	CFG_SEC("element", element_opts, CFGF_MULTI | CFGF_TITLE),
+	CFG_END()
 };
 
 float			cfg_read_interval;
 float			cfg_rate_interval;
 float			cfg_rate_variance;
 float			cfg_history_variance;
+unsigned int		cfg_lifecycles;
 int			cfg_show_all;
 int			cfg_unit_exp		= DYNAMIC_EXP;
 
@@ -246,6 +251,14 @@ static void configfile_read_history(void)
 		def->hd_interval = interval;
 		def->hd_size = size;
 
+		if (cfg_getbool(history, "always")) {
+			history_def_view(def);
+			attr_history_always();
+		}
+
+		if (cfg_getbool(history, "quantiles"))
+			def->hd_flags |= HISTORY_DEF_FLAG_QUANTILES;
+
 		if (!strcasecmp(type, "8bit"))
 			def->hd_type = HISTORY_TYPE_8;
 		else if (!strcasecmp(type, "16bit"))
@@ -254,9 +267,12 @@ static void configfile_read_history(void)
 			def->hd_type = HISTORY_TYPE_32;
 		else if (!strcasecmp(type, "64bit"))
 			def->hd_type = HISTORY_TYPE_64;
+		else if (!strcasecmp(type, "compressed"))
+			def->hd_type = HISTORY_TYPE_COMPRESSED;
 		else
 			quit("Invalid type \'%s\', must be \"(8|16|32|64)bit\""
-			     " in history definition #%d\n", type, i+1);
+			     " or \"compressed\" in history definition #%d\n",
+			     type, i+1);
 	}
 }
 
@@ -468,16 +484,58 @@ void configfile_read(void)
 	}
 }
 
+/*
+ * Open the history file, "%h" in its path expands to the hostname so
+ * that hosts sharing a configuration do not share a file.
+ */
+static void history_file_init(void)
+{
+	char path[FILENAME_MAX], host[256];
+	const char *p = cfg_getstr(cfg, "history_file");
+	size_t n = 0;
+
+	if (!p || !*p)
+		return;
+
+	if (gethostname(host, sizeof(host)) < 0)
+		strcpy(host, "localhost");
+	host[sizeof(host) - 1] = '\0';
+
+	for (; *p && n < sizeof(path) - 1; p++) {
+		if (p[0] == '%' && p[1] == 'h') {
+			n += snprintf(path + n, sizeof(path) - n, "%s", host);
+			p++;
+		} else
+			path[n++] = *p;
+	}
+
+	if (n >= sizeof(path) - 1)
+		quit("History file path too long\n");
+	path[n] = '\0';
+
+	if (cfg_getint(cfg, "history_file_size") <= 0)
+		quit("Invalid history_file_size, must be at least 1 MiB\n");
+
+	history_file_open(path,
+			  (size_t) cfg_getint(cfg, "history_file_size") << 20,
+			  cfg_getfloat(cfg, "history_sync"));
+}
+
 void conf_init(void)
 {
 	cfg_read_interval = cfg_getfloat(cfg, "read_interval");
 	cfg_rate_interval = cfg_getfloat(cfg, "rate_interval");
 	cfg_rate_variance = cfg_getfloat(cfg, "variance") * cfg_rate_interval;
 	cfg_history_variance = cfg_getfloat(cfg, "history_variance");
+	cfg_lifecycles = cfg_getfloat(cfg, "lifetime") / cfg_read_interval;
+	if (cfg_lifecycles < 1)
+		cfg_lifecycles = 1;
 	cfg_show_all = cfg_getbool(cfg, "show_all");
 	cfg_unit_exp = cfg_getint(cfg, "unit_exp");
 
-	element_parse_policy(cfg_getstr(cfg, "policy"));
+	policy_parse(cfg_getstr(cfg, "policy"));
+
+	history_file_init();
 }
 
 void set_configfile(const char *file)
@@ -509,8 +567,7 @@ void set_unit_exp(const char *name)
 
 unsigned int get_lifecycles(void)
 {
-	return (unsigned int)
-		(cfg_getfloat(cfg, "lifetime") / cfg_getfloat(cfg, "read_interval"));
+	return cfg_lifecycles;
 }
 
 void conf_shutdown(void)
@@ -28,140 +28,181 @@
 #include <bmon/element_cfg.h>
 #include <bmon/group.h>
 #include <bmon/input.h>
+#include <bmon/policy.h>
 #include <bmon/utils.h>
 
-static LIST_HEAD(allowed);
-static LIST_HEAD(denied);
+/*
+ * Read generation, incremented at the start of every read. All elements
+ * are kept on expire_list ordered by the generation they expire in.
+ */
+unsigned int element_generation;
+static LIST_HEAD(expire_list);
+
+/* interned info keys, see element_info_key() */
+static char **info_keys;
+static int ninfo_keys, info_keys_size;
+
+#define ELEMENT_HASH_MIN	64
 
-static int match_mask(const struct policy *p, const char *str)
+static unsigned int element_hash(const char *name, uint32_t id,
+				 struct element *parent)
 {
-	int i, n;
-	char c;
+	unsigned int hash = 2166136261u;
 
-	if (!p || !str)
-		return 0;
-	
-	for (i = 0, n = 0; p->p_rule[i] != '\0'; i++) {
-		if (p->p_rule[i] == '*') {
-			c = tolower(p->p_rule[i + 1]);
-			
-			if (c == '\0')
-				return 1;
-			
-			while (tolower(str[n]) != c)
-				if (str[n++] == '\0')
-					return 0;
-		} else if (tolower(p->p_rule[i]) != tolower(str[n++]))
-			return 0;
-	}
+	while (*name)
+		hash = (hash ^ (unsigned char) *name++) * 16777619u;
+
+	return hash ^ (id * 2654435761u) ^ (unsigned int) (unsigned long) parent;
+}
 
-	return str[n] == '\0' ? 1 : 0;
+static inline unsigned int index_hash(uint32_t index, struct element *parent)
+{
+	return (index * 2654435761u) ^ (unsigned int) (unsigned long) parent;
 }
 
-int element_allowed(const char *name, struct element_cfg *cfg)
+static void hash_alloc(struct element_group *g, unsigned int size)
 {
-	struct policy *p;
+	unsigned int i;
 
-	if (cfg) {
-		if (cfg->ec_flags & ELEMENT_CFG_HIDE)
-			return 0;
-		else if (cfg->ec_flags & ELEMENT_CFG_SHOW)
-			return 1;
+	g->g_hash = xcalloc(size, sizeof(struct list_head));
+	g->g_index_hash = xcalloc(size, sizeof(struct list_head));
+	g->g_hash_size = size;
+
+	for (i = 0; i < size; i++) {
+		init_list_head(&g->g_hash[i]);
+		init_list_head(&g->g_index_hash[i]);
 	}
+}
 
-	list_for_each_entry(p, &denied, p_list)
-		if (match_mask(p, name))
-			return 0;
+static void hash_grow(struct element_group *g)
+{
+	struct list_head *old = g->g_hash, *old_index = g->g_index_hash;
+	unsigned int i, old_size = g->g_hash_size;
+	struct element *e, *n;
 
-	if (!list_empty(&allowed)) {
-		list_for_each_entry(p, &allowed, p_list)
-			if (match_mask(p, name))
-				return 1;
+	hash_alloc(g, old_size * 2);
 
-		return 0;
+	for (i = 0; i < old_size; i++) {
+		list_for_each_entry_safe(e, n, &old[i], e_hash_list)
+			list_add_tail(&e->e_hash_list,
+				&g->g_hash[e->e_hash % g->g_hash_size]);
+
+		list_for_each_entry_safe(e, n, &old_index[i], e_index_list)
+			list_add_tail(&e->e_index_list,
+				&g->g_index_hash[index_hash(e->e_index,
+					e->e_parent) % g->g_hash_size]);
 	}
 
-	return 1;
+	xfree(old);
+	xfree(old_index);
 }
 
-void element_parse_policy(const char *policy)
+static void hash_insert(struct element_group *g, struct element *e)
 {
-	char *start, *copy, *save = NULL, *tok;
-	struct policy *p;
+	if (!g->g_hash)
+		hash_alloc(g, ELEMENT_HASH_MIN);
+	else if (g->g_nelements > 2 * g->g_hash_size)
+		hash_grow(g);
 
-	if (!policy)
-		return;
+	list_add_tail(&e->e_hash_list, &g->g_hash[e->e_hash % g->g_hash_size]);
+}
+
+/**
+ * Looks up an element by name, id and parent without creating it
+ *
+ * Elements are kept in a per group hash table so the lookup cost does
+ * not depend on the number of elements.
+ */
+struct element *element_find(struct element_group *group, const char *name,
+			     uint32_t id, struct element *parent)
+{
+	unsigned int hash;
+	struct element *e;
 
-	copy = strdup(policy);
-	start = copy;
+	if (!group->g_hash)
+		return NULL;
 
-	while ((tok = strtok_r(start, ",", &save)) != NULL) {
-		start = NULL;
+	hash = element_hash(name, id, parent);
 
-		p = xcalloc(1, sizeof(*p));
+	list_for_each_entry(e, &group->g_hash[hash % group->g_hash_size],
+			    e_hash_list)
+		if (e->e_hash == hash && e->e_id == id &&
+		    e->e_parent == parent && !strcmp(name, e->e_name))
+			return e;
 
-		if (*tok == '!') {
-			p->p_rule = strdup(++tok);
-			list_add_tail(&p->p_list, &denied);
-		} else {
-			p->p_rule = strdup(tok);
-			list_add_tail(&p->p_list, &allowed);
-		}
-	}
-	
-	xfree(copy);
+	return NULL;
 }
 
-struct element *__lookup_element(struct element_group *group, const char *name,
-				 uint32_t id, struct element *parent)
+/**
+ * Looks up an element by the index assigned with element_set_index()
+ *
+ * Allows inputs which know a numeric identifier of the object, e.g. the
+ * interface index, to avoid hashing and comparing names.
+ */
+struct element *element_find_index(struct element_group *group,
+				   uint32_t index, struct element *parent)
 {
 	struct list_head *list;
 	struct element *e;
 
-	if (parent)
-		list = &parent->e_childs;
-	else
-		list = &group->g_elements;
+	if (!group->g_hash)
+		return NULL;
 
-	list_for_each_entry(e, list, e_list)
-		if (!strcmp(name, e->e_name) && e->e_id == id)
+	list = &group->g_index_hash[index_hash(index, parent) %
+				    group->g_hash_size];
+
+	list_for_each_entry(e, list, e_index_list)
+		if (e->e_index == index && e->e_parent == parent)
 			return e;
 
 	return NULL;
 }
 
+void element_set_index(struct element *e, uint32_t index)
+{
+	struct element_group *g = e->e_group;
+
+	if (e->e_index == index)
+		return;
+
+	list_del(&e->e_index_list);
+	init_list_head(&e->e_index_list);
+
+	if ((e->e_index = index))
+		list_add_tail(&e->e_index_list,
+			&g->g_index_hash[index_hash(index, e->e_parent) %
+					 g->g_hash_size]);
+}
+
 struct element *element_lookup(struct element_group *group, const char *name,
 			       uint32_t id, struct element *parent)
 {
 	struct element_cfg *cfg;
 	struct element *e;
-	int i;
 
 	if (!group)
 		BUG();
 
-	if ((e = __lookup_element(group, name, id, parent)))
+	if ((e = element_find(group, name, id, parent)))
 		return e;
 
-	cfg = element_cfg_lookup(name);
-	if (!element_allowed(name, cfg))
+	if (!policy_lookup(name, &cfg))
 		return NULL;
 
 	e = xcalloc(1, sizeof(*e));
 
 	init_list_head(&e->e_list);
 	init_list_head(&e->e_childs);
+	init_list_head(&e->e_index_list);
 	init_list_head(&e->e_info_list);
 	init_list_head(&e->e_attr_sorted);
-
-	for (i = 0; i < ATTR_HASH_SIZE; i++)
-		init_list_head(&e->e_attrhash[i]);
+	init_list_head(&e->e_expire_list);
 
 	e->e_name = strdup(name);
 	e->e_id = id;
+	e->e_hash = element_hash(name, id, parent);
 	e->e_parent = parent;
 	e->e_group = group;
-	e->e_lifecycles = get_lifecycles();
 	e->e_flags = ELEMENT_FLAG_CREATED;
 	e->e_cfg = cfg;
 
@@ -179,8 +220,11 @@ struct element *element_lookup(struct element_group *group, const char *name,
 	else
 		list_add_tail(&e->e_list, &group->g_elements);
 
+	hash_insert(group, e);
 	group->g_nelements++;
 
+	element_lifesign(e, 1);
+
 	return e;
 }
 
@@ -188,7 +232,6 @@ void element_free(struct element *e)
 {
 	struct info *info, *ninfo;
 	struct element *c, *cnext;
-	struct attr *a, *an;
 	int i;
 
 	if (e->e_group->g_current == e) {
@@ -201,21 +244,28 @@ void element_free(struct element *e)
 		element_free(c);
 
 	list_for_each_entry_safe(info, ninfo, &e->e_info_list, i_list) {
-		xfree(info->i_name);
 		xfree(info->i_value);
 		list_del(&info->i_list);
 		xfree(info);
 	}
 
-	for (i = 0; i < ATTR_HASH_SIZE; i++)
-		list_for_each_entry_safe(a, an, &e->e_attrhash[i], a_list)
-			attr_free(a);
+	xfree(e->e_info);
+
+	for (i = 0; i < e->e_attrs_size; i++)
+		if (e->e_attrs[i].a_def)
+			attr_free(&e->e_attrs[i]);
+
+	xfree(e->e_attrs);
 
 	if (e->e_group) {
 		list_del(&e->e_list);
+		list_del(&e->e_hash_list);
+		list_del(&e->e_index_list);
 		e->e_group->g_nelements--;
 	}
 
+	list_del(&e->e_expire_list);
+
 	xfree(e->e_name);
 	xfree(e);
 }
@@ -271,29 +321,36 @@ void item_delete(struct item *item)
 
 #endif
 
-void element_reset_update_flag(struct element_group *g,
-			       struct element *e, void *arg)
+/**
+ * Start a new read generation
+ *
+ * Elements not updated in the new generation are no longer considered
+ * updated, see element_updated().
+ */
+void element_next_generation(void)
 {
-	DBG(3, "Reseting update flag of %s\n", e->e_name);
-	e->e_flags &= ~ELEMENT_FLAG_UPDATED;
+	element_generation++;
 }
 
 /**
  * Needs to be called after updating all attributes of an element
+ * @arg e		element
+ * @arg ts		time the values were sampled or NULL to use the
+ *			sampling time of the current read
  */
 void element_notify_update(struct element *e, timestamp_t *ts)
 {
 	struct attr *a;
 	int i;
 
-	e->e_flags |= ELEMENT_FLAG_UPDATED;
+	e->e_generation = element_generation;
 
 	if (ts == NULL)
-		ts = &rtiming.rt_last_read;
+		ts = input_timestamp();
 
-	for (i = 0; i < ATTR_HASH_SIZE; i++)
-		list_for_each_entry(a, &e->e_attrhash[i], a_list)
-			attr_notify_update(a, ts);
+	for (i = 0; i < e->e_attrs_size; i++)
+		if (e->e_attrs[i].a_def)
+			attr_notify_update(e, &e->e_attrs[i], ts);
 
 	if (e->e_usage_attr && e->e_cfg &&
 	    (a = attr_lookup(e, e->e_usage_attr->ad_id))) {
@@ -305,17 +362,61 @@ void element_notify_update(struct element *e, timestamp_t *ts)
 	}
 }
 
+/* generation a is before generation b, safe against wrap around */
+static inline int generation_before(unsigned int a, unsigned int b)
+{
+	return (int) (a - b) < 0;
+}
+
+/**
+ * Keep element alive
+ * @arg e		element
+ * @arg n		number of lifetimes to keep the element alive
+ *
+ * The element expires if it does not receive another lifesign within
+ * n * lifetime seconds.
+ */
 void element_lifesign(struct element *e, int n)
 {
-	e->e_lifecycles = n * get_lifecycles();
+	unsigned int expire = element_generation + n * get_lifecycles();
+	struct list_head *pos;
+
+	if (e->e_expire == expire && !list_empty(&e->e_expire_list))
+		return;
+
+	e->e_expire = expire;
+	list_del(&e->e_expire_list);
+
+	/*
+	 * All inputs give lifesigns of equal length so the element
+	 * usually belongs at the tail of the list.
+	 */
+	for (pos = expire_list.prev; pos != &expire_list; pos = pos->prev) {
+		struct element *p;
+
+		p = list_entry(pos, struct element, e_expire_list);
+		if (!generation_before(expire, p->e_expire))
+			break;
+	}
+
+	list_add_head(&e->e_expire_list, pos);
 }
 
-void element_check_if_dead(struct element_group *g,
-			   struct element *e, void *arg)
+/**
+ * Free all elements that have expired in the current generation
+ */
+void element_expire(void)
 {
-	if (--(e->e_lifecycles) <= 0) {
-		element_free(e);
+	struct element *e;
+
+	while (!list_empty(&expire_list)) {
+		e = list_entry(expire_list.next, struct element, e_expire_list);
+
+		if (generation_before(element_generation, e->e_expire))
+			break;
+
 		DBG(2, "Deleting dead element %s\n", e->e_name);
+		element_free(e);
 	}
 }
 
@@ -349,12 +450,18 @@ void element_set_key_attr(struct element *e, int major, int minor)
 
 	if (!(e->e_key_attr[GT_MINOR] = attr_def_lookup_id(minor)))
 		BUG();
+
+	/* key and usage attributes are always collected */
+	attr_demand_def(e->e_key_attr[GT_MAJOR], ATTR_DEMAND_VALUE);
+	attr_demand_def(e->e_key_attr[GT_MINOR], ATTR_DEMAND_VALUE);
 }
 
 void element_set_usage_attr(struct element *e, int usage)
 {
 	if (!(e->e_usage_attr = attr_def_lookup_id(usage)))
 		BUG();
+
+	attr_demand_def(e->e_usage_attr, ATTR_DEMAND_VALUE);
 }
 
 struct element *element_current(void)
@@ -474,60 +581,156 @@ struct element *element_select_prev(void)
 	return e;
 }
 
-static struct info *element_info_lookup(struct element *e, const char *name)
+/**
+ * Intern info key
+ * @arg name		name of key
+ *
+ * Inputs should intern their keys once and update the values with
+ * element_set_info() to avoid the name lookup.
+ *
+ * @return Key to be used with element_set_info()
+ */
+int element_info_key(const char *name)
 {
-	struct info *i;
+	int i;
 
-	list_for_each_entry(i, &e->e_info_list, i_list)
-		if (!strcmp(i->i_name, name))
+	for (i = 0; i < ninfo_keys; i++)
+		if (!strcmp(info_keys[i], name))
 			return i;
 
-	return NULL;
+	if (ninfo_keys >= info_keys_size) {
+		info_keys_size += 16;
+		info_keys = xrealloc(info_keys,
+				     info_keys_size * sizeof(char *));
+	}
+
+	info_keys[ninfo_keys] = strdup(name);
+
+	return ninfo_keys++;
 }
 
-void element_update_info(struct element *e, const char *name, const char *value)
+static struct info *element_info_slot(struct element *e, int key)
 {
 	struct info *i;
 
-	if ((i = element_info_lookup(e, name))) {
-		xfree(i->i_value);
-		i->i_value = strdup(value);
-		return;
+	if (key >= e->e_info_size) {
+		unsigned int size = ninfo_keys;
+
+		e->e_info = xrealloc(e->e_info, size * sizeof(struct info *));
+		memset(e->e_info + e->e_info_size, 0,
+		       (size - e->e_info_size) * sizeof(struct info *));
+		e->e_info_size = size;
+	}
+
+	if (!(i = e->e_info[key])) {
+		i = xcalloc(1, sizeof(*i));
+		i->i_name = info_keys[key];
+		i->i_value = strdup("");
+
+		e->e_info[key] = i;
+		e->e_ninfo++;
+
+		list_add_tail(&i->i_list, &e->e_info_list);
 	}
 
-	i = xcalloc(1, sizeof(*i));
-	i->i_name = strdup(name);
+	return i;
+}
+
+/**
+ * Set info value of element
+ * @arg e		element
+ * @arg key		key as returned by element_info_key()
+ * @arg value		new value
+ *
+ * The value is only replaced if it differs.
+ */
+void element_set_info(struct element *e, int key, const char *value)
+{
+	struct info *i = element_info_slot(e, key);
+
+	if (!strcmp(i->i_value, value))
+		return;
+
+	xfree(i->i_value);
 	i->i_value = strdup(value);
+}
+
+/**
+ * Check if info value needs to be updated
+ * @arg e		element
+ * @arg key		key as returned by element_info_key()
+ * @arg num		number the value is derived from
+ *
+ * Allows inputs to skip formatting values which have not changed.
+ * The number is recorded, the caller is expected to update the value
+ * if true is returned.
+ *
+ * @return True if the value was not derived from the same number.
+ */
+int element_info_stale(struct element *e, int key, uint64_t num)
+{
+	struct info *i = element_info_slot(e, key);
+
+	if (i->i_has_num && i->i_num == num)
+		return 0;
 
-	e->e_ninfo++;
+	i->i_num = num;
+	i->i_has_num = 1;
 
-	list_add_tail(&i->i_list, &e->e_info_list);
+	return 1;
+}
+
+void element_update_info(struct element *e, const char *name, const char *value)
+{
+	element_set_info(e, element_info_key(name), value);
 }
 
 void element_set_txmax(struct element *e, uint64_t max)
 {
+	static int key = -1;
 	char buf[32];
 
+	if (key < 0)
+		key = element_info_key("TxMax");
+
 	if (!e->e_cfg)
 		e->e_cfg = element_cfg_create(e->e_name);
 
 	if (e->e_cfg->ec_txmax != max)
 		e->e_cfg->ec_txmax = max;
 
-	unit_bit2str(e->e_cfg->ec_txmax * 8, buf, sizeof(buf));
-	element_update_info(e, "TxMax", buf);
+	if (element_info_stale(e, key, max)) {
+		unit_bit2str(e->e_cfg->ec_txmax * 8, buf, sizeof(buf));
+		element_set_info(e, key, buf);
+	}
 }
 
 void element_set_rxmax(struct element *e, uint64_t max)
 {
+	static int key = -1;
 	char buf[32];
 
+	if (key < 0)
+		key = element_info_key("RxMax");
+
 	if (!e->e_cfg)
 		e->e_cfg = element_cfg_create(e->e_name);
 
 	if (e->e_cfg->ec_rxmax != max)
 		e->e_cfg->ec_rxmax = max;
 
-	unit_bit2str(e->e_cfg->ec_rxmax * 8, buf, sizeof(buf));
-	element_update_info(e, "RxMax", buf);
+	if (element_info_stale(e, key, max)) {
+		unit_bit2str(e->e_cfg->ec_rxmax * 8, buf, sizeof(buf));
+		element_set_info(e, key, buf);
+	}
+}
+
+static void __exit element_exit(void)
+{
+	int i;
+
+	for (i = 0; i < ninfo_keys; i++)
+		xfree(info_keys[i]);
+
+	xfree(info_keys);
 }
@@ -26,6 +26,7 @@
 #include <bmon/conf.h>
 #include <bmon/element.h>
 #include <bmon/element_cfg.h>
+#include <bmon/policy.h>
 #include <bmon/utils.h>
 
 static LIST_HEAD(cfg_list);
@@ -38,6 +39,7 @@ struct element_cfg *element_cfg_alloc(const char *name)
 	ec->ec_name = strdup(name);
 
 	list_add_tail(&ec->ec_list, &cfg_list);
+	policy_add_cfg(ec);
 
 	return ec;
 }
@@ -58,7 +60,8 @@ void element_cfg_free(struct element_cfg *ec)
 		return;
 
 	list_del(&ec->ec_list);
-	
+	policy_invalidate();
+
 	xfree(ec->ec_name);
 	xfree(ec->ec_description);
 	xfree(ec);
@@ -75,6 +78,14 @@ struct element_cfg *element_cfg_lookup(const char *name)
 	return NULL;
 }
 
+void element_cfg_foreach(void (*cb)(struct element_cfg *, void *), void *arg)
+{
+	struct element_cfg *ec;
+
+	list_for_each_entry(ec, &cfg_list, ec_list)
+		cb(ec, arg);
+}
+
 static void __exit __element_cfg_exit(void)
 {
 	struct element_cfg *ec, *n;
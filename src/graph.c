@@ -31,6 +31,10 @@
 #include <bmon/unit.h>
 #include <bmon/utils.h>
 
+/* values of the window drawn, grown to the widest graph */
+static uint64_t *values;
+static int nvalues;
+
 size_t graph_row_size(struct graph_cfg *cfg)
 {
 	/* +1 for trailing \0 */
@@ -97,17 +101,25 @@ static void fill_table(struct graph *g, struct graph_table *tbl,
 		*tbl_pos(cfg, tbl->gt_table, i, cfg->gc_width) = '\0';
 
 	/* leave table blank if there is no data */
-	if (!h || !data->hs_data)
+	if (!h || !h->h_data)
 		return;
 
 	if (cfg->gc_width > h->h_definition->hd_size)
 		BUG();
 
-	/* find the largest peak */
+	/*
+	 * Read the window once, newest first, which decodes compressed
+	 * history sequentially, and find the largest peak.
+	 */
+	if (nvalues < cfg->gc_width) {
+		nvalues = cfg->gc_width;
+		values = xrealloc(values, nvalues * sizeof(uint64_t));
+	}
+
 	for (n = h->h_index, i = 0; i < cfg->gc_width; i++) {
 		if (--n < 0)
 			n = h->h_definition->hd_size - 1;
-		v = history_data(h, data, n);
+		v = values[i] = history_data_cf(h, data, n, cfg->gc_cf);
 		if (v != HISTORY_UNKNOWN && max < v)
 			max = v;
 	}
@@ -118,12 +130,10 @@ static void fill_table(struct graph *g, struct graph_table *tbl,
 	for (i = 0; i < cfg->gc_height; i++)
 		tbl->gt_scale[i] = (double) (i + 1) * step;
 
-	for (n = h->h_index, i = 0; i < cfg->gc_width; i++) {
+	for (i = 0; i < cfg->gc_width; i++) {
 		char * col = at_col(tbl->gt_table, i);
 
-		if (--n < 0)
-			n = h->h_definition->hd_size - 1;
-		v = history_data(h, data, n);
+		v = values[i];
 
 		if (v == HISTORY_UNKNOWN) {
 			for (t = 0; t < cfg->gc_height; t++)
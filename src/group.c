@@ -178,17 +178,19 @@ static void group_free(struct element_group *g)
 	list_for_each_entry_safe(e, n, &g->g_elements, e_list)
 		element_free(e);
 
+	xfree(g->g_hash);
+	xfree(g->g_index_hash);
 	xfree(g);
 }
 
 void reset_update_flags(void)
 {
-	group_foreach_recursive(&element_reset_update_flag, NULL);
+	element_next_generation();
 }
 
 void free_unused_elements(void)
 {
-	group_foreach_recursive(&element_check_if_dead, NULL);
+	element_expire();
 }
 
 struct group_hdr *group_lookup_hdr(const char *name)
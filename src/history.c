@@ -25,12 +25,53 @@
 #include <bmon/bmon.h>
 #include <bmon/conf.h>
 #include <bmon/history.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
 #include <bmon/utils.h>
 
+/* rings are carved from slabs of this size */
+#define HISTORY_SLAB_SIZE	(64 * 1024)
+
 static LIST_HEAD(def_list);
 
 static struct history_def *current_history;
 
+unsigned int history_view_version = 1;
+
+/* tiers have been derived from the definitions */
+static int chained;
+
+static const char *cf_names[__HISTORY_CF_MAX] = {
+	[HISTORY_CF_AVG]	= "avg",
+	[HISTORY_CF_MIN]	= "min",
+	[HISTORY_CF_MAX]	= "max",
+};
+
+/*
+ * Ring storage of all histories. Slabs are never returned before exit,
+ * released rings are kept on a free list of their definition since all
+ * rings of a definition are of equal size.
+ */
+struct history_slab
+{
+	struct list_head	sl_list;
+	char			sl_data[];
+};
+
+static struct history_arena
+{
+	struct list_head	ha_slabs;
+	char *			ha_next;
+	size_t			ha_avail;
+	struct history_usage	ha_usage;
+} arena = {
+	.ha_slabs = LIST_SELF(arena.ha_slabs),
+};
+
+static int exiting;
+
+static void history_release(void);
+
 struct history_def *history_def_lookup(const char *name)
 {
 	struct history_def *def;
@@ -53,6 +94,7 @@ struct history_def *history_def_alloc(const char *name)
 	def->hd_name = strdup(name);
 
 	list_add_tail(&def->hd_list, &def_list);
+	chained = 0;
 
 	DBG(1, "[DBG] New history definition %s\n", name);
 
@@ -68,48 +110,315 @@ static void history_def_free(struct history_def *def)
 	xfree(def);
 }
 
-static void *history_alloc_data(struct history_def *def)
+/*
+ * Compressed histories
+ *
+ * The intervals are split into blocks of HISTORY_BLOCK_SAMPLES, each
+ * interval stores hd_values samples. A sample is stored as the zigzag varint of the difference
+ * between its delta to the previous sample and the previous delta,
+ * a single byte for steady rates. Every block starts from zero and
+ * decodes on its own. Unknown samples are stored as the non-canonical
+ * varint 0x80 0x00 and leave the predictor untouched.
+ *
+ * One block more than required is kept so that a block being refilled
+ * after wrapping around never drops samples within hd_size.
+ */
+struct history_block
+{
+	uint8_t *		hb_data;
+	uint32_t		hb_len,
+				hb_size;
+	/* complete intervals */
+	uint32_t		hb_count;
+};
+
+struct history_packed
+{
+	/* intervals stored */
+	uint64_t		hp_seq;
+	/* predictor of the block being filled, per value */
+	uint64_t		hp_prev[2 * __HISTORY_CF_MAX],
+				hp_delta[2 * __HISTORY_CF_MAX];
+	unsigned int		hp_nblocks;
+	struct history_block	hp_blocks[];
+};
+
+/* last block decoded, sequential reads decode every block once */
+static struct {
+	struct history *	h;
+	uint64_t		first;
+	uint32_t		count;
+	uint64_t		data[HISTORY_BLOCK_SAMPLES][2 * __HISTORY_CF_MAX];
+} decoded;
+
+static unsigned int packed_nblocks(struct history_def *def)
+{
+	return (def->hd_size + HISTORY_BLOCK_SAMPLES - 1) /
+		HISTORY_BLOCK_SAMPLES + 1;
+}
+
+static void block_append(struct history_block *b, uint8_t *buf, int len)
 {
-	return xcalloc(def->hd_size, def->hd_type);
+	if (b->hb_len + len > b->hb_size) {
+		uint32_t size = b->hb_size ? b->hb_size * 2 : 32;
+
+		while (size < b->hb_len + len)
+			size *= 2;
+
+		b->hb_data = xrealloc(b->hb_data, size);
+		arena.ha_usage.hu_used += size - b->hb_size;
+		arena.ha_usage.hu_reserved += size - b->hb_size;
+		b->hb_size = size;
+	}
+
+	memcpy(b->hb_data + b->hb_len, buf, len);
+	b->hb_len += len;
 }
 
-static void history_store_data(struct history *h, struct history_store *hs,
-			       uint64_t total, float diff)
+static void packed_store(struct history *h, int k, uint64_t v)
 {
-	uint64_t delta;
+	struct history_packed *p = h->h_data;
+	struct history_block *b;
+	uint8_t buf[10];
+	uint64_t delta, zz;
+	int len = 0;
+
+	b = &p->hp_blocks[(p->hp_seq / HISTORY_BLOCK_SAMPLES) % p->hp_nblocks];
+
+	if (k == 0 && !(p->hp_seq % HISTORY_BLOCK_SAMPLES)) {
+		b->hb_len = b->hb_count = 0;
+		memset(p->hp_prev, 0, sizeof(p->hp_prev));
+		memset(p->hp_delta, 0, sizeof(p->hp_delta));
+	}
+
+	if (v == HISTORY_UNKNOWN) {
+		buf[len++] = 0x80;
+		buf[len++] = 0x00;
+	} else {
+		delta = v - p->hp_prev[k];
+		zz = delta - p->hp_delta[k];
+		zz = (zz << 1) ^ (uint64_t) ((int64_t) zz >> 63);
+
+		p->hp_prev[k] = v;
+		p->hp_delta[k] = delta;
+
+		do {
+			buf[len] = zz & 0x7f;
+			zz >>= 7;
+			if (zz)
+				buf[len] |= 0x80;
+			len++;
+		} while (zz);
+	}
+
+	block_append(b, buf, len);
+
+	if (k == h->h_definition->hd_values - 1)
+		b->hb_count++;
+}
+
+static void packed_decode(struct history *h, uint64_t first)
+{
+	struct history_packed *p = h->h_data;
+	struct history_block *b;
+	uint64_t prev[2 * __HISTORY_CF_MAX] = {0};
+	uint64_t delta[2 * __HISTORY_CF_MAX] = {0}, zz;
+	unsigned int i, k, shift, values = h->h_definition->hd_values;
+	uint8_t *c;
+
+	b = &p->hp_blocks[(first / HISTORY_BLOCK_SAMPLES) % p->hp_nblocks];
+	c = b->hb_data;
+
+	for (i = 0; i < b->hb_count; i++) {
+		for (k = 0; k < values; k++) {
+			if (c[0] == 0x80 && c[1] == 0x00) {
+				decoded.data[i][k] = HISTORY_UNKNOWN;
+				c += 2;
+				continue;
+			}
+
+			zz = 0;
+			shift = 0;
+			do {
+				zz |= (uint64_t) (*c & 0x7f) << shift;
+				shift += 7;
+			} while (*c++ & 0x80);
+
+			delta[k] += (zz >> 1) ^ -(zz & 1);
+			prev[k] += delta[k];
+			decoded.data[i][k] = prev[k];
+		}
+	}
+
+	decoded.h = h;
+	decoded.first = first;
+	decoded.count = b->hb_count;
+}
+
+static uint64_t packed_data(struct history *h, int k, int index)
+{
+	struct history_packed *p = h->h_data;
+	int size = h->h_definition->hd_size;
+	uint64_t age, seq, first;
+	unsigned int off;
 
-	if (!hs->hs_data) {
-		if (total == HISTORY_UNKNOWN)
-			return;
+	age = (h->h_index - 1 - index + 2 * size) % size;
+	if (age >= p->hp_seq)
+		return 0;
+
+	seq = p->hp_seq - 1 - age;
+	off = seq % HISTORY_BLOCK_SAMPLES;
+	first = seq - off;
+
+	if (decoded.h != h || decoded.first != first || off >= decoded.count)
+		packed_decode(h, first);
+
+	return decoded.data[off][k];
+}
 
-		hs->hs_data = history_alloc_data(h->h_definition);
+static void packed_free(struct history *h)
+{
+	struct history_packed *p = h->h_data;
+	unsigned int i;
+
+	for (i = 0; i < p->hp_nblocks; i++) {
+		arena.ha_usage.hu_used -= p->hp_blocks[i].hb_size;
+		arena.ha_usage.hu_reserved -= p->hp_blocks[i].hb_size;
+		xfree(p->hp_blocks[i].hb_data);
 	}
 
-	if (total == HISTORY_UNKNOWN)
-		delta = HISTORY_UNKNOWN;
+	if (decoded.h == h)
+		decoded.h = NULL;
+}
+
+static size_t ring_size(struct history_def *def)
+{
+	size_t size;
+
+	if (def->hd_type == HISTORY_TYPE_COMPRESSED)
+		size = sizeof(struct history_packed) +
+		       packed_nblocks(def) * sizeof(struct history_block);
+	else
+		size = def->hd_values * (size_t) def->hd_size * def->hd_type;
+
+	/* keep rings aligned, a released ring stores the free list link */
+	return (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+}
+
+static void *ring_alloc(struct history_def *def)
+{
+	size_t size = def->hd_ring_size;
+	void *ring;
+
+	if ((ring = def->hd_free_rings))
+		def->hd_free_rings = *(void **) ring;
 	else {
-		delta = (total - hs->hs_prev_total);
+		if (arena.ha_avail < size) {
+			struct history_slab *slab;
+			size_t n = HISTORY_SLAB_SIZE;
+
+			if (n < size)
+				n = size;
 
-		if (delta > 0)
-			delta /= diff;
-		hs->hs_prev_total = total;
+			slab = xcalloc(1, sizeof(*slab) + n);
+			list_add_tail(&slab->sl_list, &arena.ha_slabs);
+
+			arena.ha_next = slab->sl_data;
+			arena.ha_avail = n;
+			arena.ha_usage.hu_reserved += n;
+		}
+
+		ring = arena.ha_next;
+		arena.ha_next += size;
+		arena.ha_avail -= size;
 	}
 
+	memset(ring, 0, size);
+
+	return ring;
+}
+
+static void ring_free(struct history_def *def, void *ring)
+{
+	*(void **) ring = def->hd_free_rings;
+	def->hd_free_rings = ring;
+}
+
+static void ring_account(struct history_def *def, int n)
+{
+	arena.ha_usage.hu_used += n * (ssize_t) def->hd_ring_size;
+	arena.ha_usage.hu_rings += n;
+
+	if (exiting && !arena.ha_usage.hu_rings)
+		history_release();
+}
+
+/**
+ * Report memory used by the history arena
+ * @arg usage		Usage to fill out
+ *
+ * A mapped history file is accounted as reserved.
+ */
+void history_usage(struct history_usage *usage)
+{
+	*usage = arena.ha_usage;
+	usage->hu_reserved += history_file_size();
+}
+
+static void history_alloc_data(struct history *h)
+{
+	struct history_def *def = h->h_definition;
+
+	if (!h->h_key || !(h->h_data = history_file_alloc(h)))
+		h->h_data = ring_alloc(def);
+
+	xfree(h->h_key);
+	h->h_key = NULL;
+
+	ring_account(def, 1);
+
+	if (def->hd_type == HISTORY_TYPE_COMPRESSED)
+		((struct history_packed *) h->h_data)->hp_nblocks =
+			packed_nblocks(def);
+}
+
+static uint64_t history_delta(struct history_store *hs, uint64_t total,
+			      float diff)
+{
+	uint64_t delta;
+
+	delta = (total - hs->hs_prev_total);
+
+	if (delta > 0)
+		delta /= diff;
+	hs->hs_prev_total = total;
+
+	return delta;
+}
+
+static void history_put(struct history *h, int k, uint64_t delta)
+{
+	int slot = (h->h_index * h->h_definition->hd_values) + k;
+
 	switch (h->h_definition->hd_type) {
 	case HISTORY_TYPE_8:
-		((uint8_t *) hs->hs_data)[h->h_index] = (uint8_t) delta;
+		((uint8_t *) h->h_data)[slot] = (uint8_t) delta;
 		break;
 	
 	case HISTORY_TYPE_16:
-		((uint16_t *) hs->hs_data)[h->h_index] = (uint16_t) delta;
+		((uint16_t *) h->h_data)[slot] = (uint16_t) delta;
 		break;
 
 	case HISTORY_TYPE_32:
-		((uint32_t *) hs->hs_data)[h->h_index] = (uint32_t) delta;
+		((uint32_t *) h->h_data)[slot] = (uint32_t) delta;
 		break;
 
 	case HISTORY_TYPE_64:
-		((uint64_t *) hs->hs_data)[h->h_index] = (uint64_t) delta;
+		((uint64_t *) h->h_data)[slot] = (uint64_t) delta;
+		break;
+
+	case HISTORY_TYPE_COMPRESSED:
+		packed_store(h, k, delta);
 		break;
 
 	default:
@@ -119,44 +428,259 @@ static void history_store_data(struct history *h, struct history_store *hs,
 
 static inline void inc_history_index(struct history *h)
 {
+	if (h->h_data && h->h_definition->hd_type == HISTORY_TYPE_COMPRESSED)
+		((struct history_packed *) h->h_data)->hp_seq++;
+
 	if (h->h_index < (h->h_definition->hd_size - 1))
 		h->h_index++;
 	else
 		h->h_index = 0;
 }
 
-uint64_t history_data(struct history *h, struct history_store *hs, int index)
+/**
+ * Consolidated sample of history
+ * @arg h		History
+ * @arg hs		Direction of sample (h_rx or h_tx)
+ * @arg index		Index of interval
+ * @arg cf		Consolidation function
+ *
+ * Tiers which are not consolidated return the same sample for every
+ * consolidation function.
+ */
+uint64_t history_data_cf(struct history *h, struct history_store *hs,
+			 int index, int cf)
 {
+	struct history_def *def = h->h_definition;
+	int k, slot;
+
+	if (!def->hd_base)
+		cf = HISTORY_CF_AVG;
+
+	k = (cf * 2) + hs->hs_offset;
+	slot = (index * def->hd_values) + k;
+
 	switch (h->h_definition->hd_type) {
 	case HISTORY_TYPE_8: {
-		uint8_t v = ((uint8_t *) hs->hs_data)[index];
+		uint8_t v = ((uint8_t *) h->h_data)[slot];
 		return (v == (uint8_t) -1) ? HISTORY_UNKNOWN : v;
 	}
 	
 	case HISTORY_TYPE_16: {
-		uint16_t v = ((uint16_t *) hs->hs_data)[index];
+		uint16_t v = ((uint16_t *) h->h_data)[slot];
 		return (v == (uint16_t) -1) ? HISTORY_UNKNOWN : v;
 	}
  
 	case HISTORY_TYPE_32: {
-		uint32_t v = ((uint32_t *) hs->hs_data)[index];
+		uint32_t v = ((uint32_t *) h->h_data)[slot];
 		return (v == (uint32_t) -1) ? HISTORY_UNKNOWN : v;
 	}
 
 	case HISTORY_TYPE_64: {
-		uint64_t v = ((uint64_t *) hs->hs_data)[index];
+		uint64_t v = ((uint64_t *) h->h_data)[slot];
 		return (v == (uint64_t) -1) ? HISTORY_UNKNOWN : v;
 	}
 
+	case HISTORY_TYPE_COMPRESSED:
+		return packed_data(h, k, index);
+
 	default:
 		BUG();
 	}
 }
 
+uint64_t history_data(struct history *h, struct history_store *hs, int index)
+{
+	return history_data_cf(h, hs, index, HISTORY_CF_AVG);
+}
+
+int history_cf_lookup(const char *name)
+{
+	int i;
+
+	for (i = 0; i < __HISTORY_CF_MAX; i++)
+		if (!strcasecmp(cf_names[i], name))
+			return i;
+
+	return -1;
+}
+
+const char *history_cf_name(int cf)
+{
+	if (cf < 0 || cf >= __HISTORY_CF_MAX)
+		BUG();
+
+	return cf_names[cf];
+}
+
+static void history_consolidate(struct attr *, struct history *, uint64_t *,
+				timestamp_t *);
+
+/*
+ * Store the samples of an interval, v holds a rx/tx pair per consolidation
+ * function, and feed them to the tiers consolidated from this one.
+ */
+static void history_store(struct attr *a, struct history *h, uint64_t *v,
+			  timestamp_t *ts)
+{
+	struct history_quant *q = h->h_quant;
+	struct history *upper;
+	int k;
+
+	/* nothing is stored before the first known sample */
+	if (h->h_data)
+		for (k = 0; k < h->h_definition->hd_values; k++)
+			history_put(h, k, v[k]);
+
+	inc_history_index(h);
+
+	if (q) {
+		for (k = 0; k < 2; k++) {
+			q->hq_last[k] = q->hq_cur[k];
+			sketch_reset(&q->hq_cur[k]);
+		}
+	}
+
+	list_for_each_entry(upper, &a->a_history_list, h_list) {
+		if (upper->h_definition->hd_base != h->h_definition)
+			continue;
+
+		if (q && upper->h_quant)
+			for (k = 0; k < 2; k++)
+				sketch_merge(&upper->h_quant->hq_cur[k],
+					     &q->hq_last[k]);
+
+		history_consolidate(a, upper, v, ts);
+	}
+}
+
+/* add the rates since the previous read to the sketches */
+static void history_sample(struct attr *a, struct history *h, timestamp_t *ts)
+{
+	struct history_quant *q = h->h_quant;
+	uint64_t total[2] = { a->a_rx_rate.r_total, a->a_tx_rate.r_total };
+	float timediff;
+	int k;
+
+	if (a->a_def->ad_type != ATTR_TYPE_COUNTER) {
+		for (k = 0; k < 2; k++)
+			sketch_add(&q->hq_cur[k], total[k]);
+		return;
+	}
+
+	if (q->hq_prev_ts.tv_sec &&
+	    (timediff = timestamp_diff(&q->hq_prev_ts, ts)) > 0.0f)
+		for (k = 0; k < 2; k++)
+			if (total[k] >= q->hq_prev[k])
+				sketch_add(&q->hq_cur[k],
+					   (total[k] - q->hq_prev[k]) /
+					   timediff);
+
+	q->hq_prev[0] = total[0];
+	q->hq_prev[1] = total[1];
+	copy_timestamp(&q->hq_prev_ts, ts);
+}
+
+/**
+ * Estimate rate quantile
+ * @arg h		History
+ * @arg dir		0 for rx, 1 for tx
+ * @arg q		Quantile, 0.0 to 1.0
+ * @arg v		Estimated rate per second
+ *
+ * Covers the rates of the last completed and the current interval.
+ *
+ * @return 0 on success or -1 if no rates are known.
+ */
+int history_quantile(struct history *h, int dir, double q, double *v)
+{
+	struct sketch s;
+
+	if (!h->h_quant)
+		return -1;
+
+	s = h->h_quant->hq_last[dir];
+	sketch_merge(&s, &h->h_quant->hq_cur[dir]);
+
+	return sketch_quantile(&s, q, v);
+}
+
+/**
+ * Return the first history definition collecting quantiles
+ */
+struct history_def *history_quantile_def(void)
+{
+	struct history_def *def;
+
+	list_for_each_entry(def, &def_list, hd_list)
+		if (def->hd_flags & HISTORY_DEF_FLAG_QUANTILES)
+			return def;
+
+	return NULL;
+}
+
+static void history_consolidate(struct attr *a, struct history *h,
+				uint64_t *v, timestamp_t *ts)
+{
+	struct history_cons *c = &h->h_cons;
+	uint64_t out[2 * __HISTORY_CF_MAX];
+	int dir, known = 0;
+
+	for (dir = 0; dir < 2; dir++) {
+		uint64_t avg = v[(HISTORY_CF_AVG * 2) + dir],
+			 min = v[(HISTORY_CF_MIN * 2) + dir],
+			 max = v[(HISTORY_CF_MAX * 2) + dir];
+
+		if (avg == HISTORY_UNKNOWN)
+			continue;
+
+		if (!c->hc_known[dir] || min < c->hc_min[dir])
+			c->hc_min[dir] = min;
+		if (!c->hc_known[dir] || max > c->hc_max[dir])
+			c->hc_max[dir] = max;
+
+		c->hc_sum[dir] += avg;
+		c->hc_known[dir]++;
+	}
+
+	if (++c->hc_steps < h->h_definition->hd_steps)
+		return;
+
+	for (dir = 0; dir < 2; dir++) {
+		if (c->hc_known[dir]) {
+			out[(HISTORY_CF_AVG * 2) + dir] =
+				c->hc_sum[dir] / c->hc_known[dir];
+			out[(HISTORY_CF_MIN * 2) + dir] = c->hc_min[dir];
+			out[(HISTORY_CF_MAX * 2) + dir] = c->hc_max[dir];
+			known = 1;
+		} else {
+			out[(HISTORY_CF_AVG * 2) + dir] = HISTORY_UNKNOWN;
+			out[(HISTORY_CF_MIN * 2) + dir] = HISTORY_UNKNOWN;
+			out[(HISTORY_CF_MAX * 2) + dir] = HISTORY_UNKNOWN;
+		}
+	}
+
+	memset(c, 0, sizeof(*c));
+
+	if (!h->h_data && known)
+		history_alloc_data(h);
+
+	copy_timestamp(&h->h_last_update, ts);
+	history_store(a, h, out, ts);
+}
+
 void history_update(struct attr *a, struct history *h, timestamp_t *ts)
 {
 	struct history_def *def = h->h_definition;
+	uint64_t v[2 * __HISTORY_CF_MAX];
 	float timediff;
+	int k;
+
+	/* consolidated tiers are fed by their base tier */
+	if (def->hd_base)
+		return;
+
+	if (h->h_quant)
+		history_sample(a, h, ts);
 
 	if (h->h_last_update.tv_sec)
 		timediff = timestamp_diff(&h->h_last_update, ts);
@@ -193,18 +717,26 @@ void history_update(struct attr *a, struct history *h, timestamp_t *ts)
 		return;
 
 update:
-	history_store_data(h, &h->h_rx, a->a_rx_rate.r_total, timediff);
-	history_store_data(h, &h->h_tx, a->a_tx_rate.r_total, timediff);
-	inc_history_index(h);
+	if (!h->h_data)
+		history_alloc_data(h);
+
+	v[0] = history_delta(&h->h_rx, a->a_rx_rate.r_total, timediff);
+	v[1] = history_delta(&h->h_tx, a->a_tx_rate.r_total, timediff);
+
+	/* a single sample is its own minimum and maximum */
+	for (k = 2; k < 2 * __HISTORY_CF_MAX; k++)
+		v[k] = v[k % 2];
+
+	history_store(a, h, v, ts);
 
 	goto update_ts;
 
 discard:
-	while(timediff >= (def->hd_interval / 2)) {
-		history_store_data(h, &h->h_rx, HISTORY_UNKNOWN, 0.0f);
-		history_store_data(h, &h->h_tx, HISTORY_UNKNOWN, 0.0f);
+	for (k = 0; k < 2 * __HISTORY_CF_MAX; k++)
+		v[k] = HISTORY_UNKNOWN;
 
-		inc_history_index(h);
+	while(timediff >= (def->hd_interval / 2)) {
+		history_store(a, h, v, ts);
 		timediff -= def->hd_interval;
 	}
 
@@ -216,19 +748,82 @@ update_ts:
 	copy_timestamp(&h->h_last_update, ts);
 }
 
+/*
+ * Derive the consolidation tiers. A definition is consolidated from the
+ * definition with the longest interval it is a multiple of, as long as
+ * that interval is not shorter than the read interval.
+ */
+static void history_chain(void)
+{
+	struct history_def *def, *base;
+	float steps;
+
+	list_for_each_entry(def, &def_list, hd_list) {
+		def->hd_base = NULL;
+		def->hd_steps = 0;
+
+		list_for_each_entry(base, &def_list, hd_list) {
+			if (base->hd_interval >= def->hd_interval ||
+			    base->hd_interval < cfg_read_interval)
+				continue;
+
+			steps = def->hd_interval / base->hd_interval;
+			if (fabsf(steps - roundf(steps)) > 0.001f)
+				continue;
+
+			if (!def->hd_base ||
+			    base->hd_interval > def->hd_base->hd_interval) {
+				def->hd_base = base;
+				def->hd_steps = (int) roundf(steps);
+			}
+		}
+
+		def->hd_values = def->hd_base ? 2 * __HISTORY_CF_MAX : 2;
+
+		DBG(1, "[DBG] History %s consolidated from %s\n", def->hd_name,
+		    def->hd_base ? def->hd_base->hd_name : "reads");
+	}
+
+	chained = 1;
+
+	/* a viewed tier needs the tiers below */
+	list_for_each_entry(def, &def_list, hd_list) {
+		if (def->hd_flags & HISTORY_DEF_FLAG_VIEWED)
+			history_def_view(def->hd_base);
+
+		if (def->hd_flags & HISTORY_DEF_FLAG_QUANTILES)
+			for (base = def->hd_base; base; base = base->hd_base)
+				base->hd_flags |= HISTORY_DEF_FLAG_QUANTILES;
+	}
+}
+
 struct history *history_alloc(struct history_def *def)
 {
 	struct history *h;
 
+	if (!chained)
+		history_chain();
+
 	h  = xcalloc(1, sizeof(*h));
 
 	init_list_head(&h->h_list);
+	init_list_head(&h->h_file_list);
 
 	h->h_definition = def;
+	h->h_tx.hs_offset = 1;
+
+	if (!def->hd_ring_size)
+		def->hd_ring_size = ring_size(def);
 
 	h->h_min_interval = (def->hd_interval - (cfg_read_interval / 2.0f));
 	h->h_max_interval = (def->hd_interval / cfg_history_variance);
 
+	if (def->hd_flags & HISTORY_DEF_FLAG_QUANTILES) {
+		h->h_quant = xcalloc(1, sizeof(*h->h_quant));
+		arena.ha_usage.hu_used += sizeof(*h->h_quant);
+		arena.ha_usage.hu_reserved += sizeof(*h->h_quant);
+	}
+
 	return h;
 }
 
@@ -237,22 +832,157 @@ void history_free(struct history *h)
 	if (!h)
 		return;
 
-	xfree(h->h_rx.hs_data);
-	xfree(h->h_tx.hs_data);
-
 	list_del(&h->h_list);
+	xfree(h->h_key);
+
+	if (h->h_quant) {
+		arena.ha_usage.hu_used -= sizeof(*h->h_quant);
+		arena.ha_usage.hu_reserved -= sizeof(*h->h_quant);
+		xfree(h->h_quant);
+	}
+
+	if (h->h_data) {
+		struct history_def *def = h->h_definition;
+
+		if (h->h_record)
+			history_file_detach(h);
+		else {
+			if (def->hd_type == HISTORY_TYPE_COMPRESSED)
+				packed_free(h);
+
+			ring_free(def, h->h_data);
+		}
+
+		/* may release the definitions when exiting */
+		ring_account(def, -1);
+	}
 
 	xfree(h);
 }
 
-void history_attach(struct attr *attr)
+/**
+ * Find history of an attribute
+ * @arg attr		Attribute
+ * @arg def		History definition
+ *
+ * @return History or NULL if the attribute has none of this definition.
+ */
+struct history *history_lookup(struct attr *attr, struct history_def *def)
+{
+	struct history *h;
+
+	list_for_each_entry(h, &attr->a_history_list, h_list)
+		if (h->h_definition == def)
+			return h;
+
+	return NULL;
+}
+
+static int element_path(struct element *e, char *buf, size_t len)
+{
+	int n;
+
+	if (e->e_parent)
+		n = element_path(e->e_parent, buf, len);
+	else
+		n = snprintf(buf, len, "%s", e->e_group->g_name);
+
+	if (n < 0 || n >= len)
+		return len;
+
+	return n + snprintf(buf + n, len - n, "/%s", e->e_name);
+}
+
+/*
+ * Reattach history to its record in the history file. The intervals
+ * missed while bmon was not running are marked unknown. Otherwise the
+ * key is kept so the record is allocated with the first sample.
+ */
+static void history_persist(struct history *h, struct element *e,
+			    struct attr *attr)
+{
+	struct history_def *def = h->h_definition;
+	char key[HISTORY_KEY_MAX], path[HISTORY_KEY_MAX];
+	double age, missed;
+	int n, k;
+
+	if (def->hd_type == HISTORY_TYPE_COMPRESSED)
+		return;
+
+	if (element_path(e, path, sizeof(path)) >= sizeof(path))
+		return;
+
+	n = snprintf(key, sizeof(key), "%s:%s/%s", def->hd_name, path,
+		     attr->a_def->ad_name);
+	if (n < 0 || n >= sizeof(key))
+		return;
+
+	h->h_key = strdup(key);
+
+	if (!(h->h_data = history_file_attach(h, &age)))
+		return;
+
+	xfree(h->h_key);
+	h->h_key = NULL;
+	ring_account(def, 1);
+
+	missed = age / def->hd_interval;
+	if (missed > def->hd_size)
+		missed = def->hd_size;
+
+	for (n = 0; n < (int) missed; n++) {
+		for (k = 0; k < def->hd_values; k++)
+			history_put(h, k, HISTORY_UNKNOWN);
+		inc_history_index(h);
+	}
+}
+
+/**
+ * Attach histories to an attribute
+ * @arg e		Element of attribute
+ * @arg attr		Attribute collecting history
+ *
+ * Attaches a history for every definition viewed by an output which
+ * the attribute does not have yet. Called again whenever an output
+ * starts to view another definition.
+ */
+void history_attach(struct element *e, struct attr *attr)
 {
 	struct history_def *def;
 	struct history *h;
 
+	if (!chained)
+		history_chain();
+
 	list_for_each_entry(def, &def_list, hd_list) {
+		if (!(def->hd_flags & HISTORY_DEF_FLAG_VIEWED) ||
+		    history_lookup(attr, def))
+			continue;
+
 		h = history_alloc(def);
 		list_add_tail(&h->h_list, &attr->a_history_list);
+
+		if (history_file_size())
+			history_persist(h, e, attr);
+	}
+
+	attr->a_history_version = history_view_version;
+}
+
+/**
+ * Mark history definition as viewed
+ * @arg def		History definition
+ *
+ * History is only collected for definitions which are viewed by an
+ * output or configured to be collected regardless, including the
+ * tiers they are consolidated from.
+ */
+void history_def_view(struct history_def *def)
+{
+	for (; def && !(def->hd_flags & HISTORY_DEF_FLAG_VIEWED);
+	     def = def->hd_base) {
+		def->hd_flags |= HISTORY_DEF_FLAG_VIEWED;
+		history_view_version++;
 	}
 }
 
@@ -308,10 +1038,29 @@ struct history_def *history_current(void)
 	return current_history;
 }
 
-static void __exit history_exit(void)
+static void history_release(void)
 {
 	struct history_def *def, *n;
+	struct history_slab *slab, *sn;
 
 	list_for_each_entry_safe(def, n, &def_list, hd_list)
 		history_def_free(def);
+
+	list_for_each_entry_safe(slab, sn, &arena.ha_slabs, sl_list)
+		xfree(slab);
+
+	history_file_close();
+}
+
+/*
+ * Elements may be freed after this destructor has run. Definitions and
+ * slabs are only released once the last ring has been returned.
+ */
+static void __exit history_exit(void)
+{
+	history_file_sync(1);
+	exiting = 1;
+
+	if (!arena.ha_usage.hu_rings)
+		history_release();
 }
@@ -0,0 +1,470 @@
+/*
+ * history_file.c	Persistent History
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/history.h>
+#include <bmon/utils.h>
+
+#include <sys/mman.h>
+#include <sys/file.h>
+
+/*
+ * The history file holds a header followed by records, each record is
+ * the ring of a history plus the little state needed to continue it.
+ * Rings are written in place by history_update(), the state is only
+ * copied into the records when the file is synced. Records are never
+ * removed, a record whose element has not been seen again is reused
+ * once the file is full.
+ *
+ * The file is locked while mapped, a second bmon on the same file keeps
+ * its history in memory.
+ */
+#define HISTORY_FILE_MAGIC	"BMONHIST"
+#define HISTORY_FILE_VERSION	2
+#define HISTORY_FILE_HASH	1024
+
+#define RECORD_FLAG_ATTACHED	0x01	/* in use by this process */
+
+struct history_file_hdr
+{
+	char			hf_magic[8];
+	uint32_t		hf_version;
+	uint32_t		hf_hdr_len;
+	uint64_t		hf_size;
+	/* end of the last record */
+	uint64_t		hf_used;
+	/* wall clock time of the last sync */
+	double			hf_saved;
+};
+
+struct history_record
+{
+	uint32_t		hr_len;
+	uint32_t		hr_flags;
+	char			hr_key[HISTORY_KEY_MAX];
+	uint32_t		hr_ring_size;
+	int32_t			hr_index;
+	/* layout of the ring, see struct history_def */
+	int32_t			hr_type;
+	int32_t			hr_size;
+	int32_t			hr_values;
+	float			hr_interval;
+	double			hr_saved;
+	uint64_t		hr_data[];
+};
+
+struct record_ref
+{
+	struct history_record *	rr_record;
+	struct record_ref *	rr_next;
+};
+
+static struct history_file_hdr *hdr;
+static int lock_fd = -1;
+static struct record_ref *hash[HISTORY_FILE_HASH];
+static LIST_HEAD(attached);
+static float sync_interval;
+static double last_sync;
+
+static double wall_clock(void)
+{
+	timestamp_t ts;
+
+	wall_timestamp(&ts);
+
+	return (double) ts.tv_sec + (double) ts.tv_usec / 1000000.0;
+}
+
+static unsigned int key_hash(const char *key)
+{
+	unsigned int h = 2166136261u;
+
+	while (*key)
+		h = (h ^ (unsigned char) *key++) * 16777619u;
+
+	return h % HISTORY_FILE_HASH;
+}
+
+static struct history_record *record_at(uint64_t off)
+{
+	return (struct history_record *) ((char *) hdr + off);
+}
+
+static void record_hash(struct history_record *r)
+{
+	struct record_ref *ref;
+	unsigned int h = key_hash(r->hr_key);
+
+	ref = xcalloc(1, sizeof(*ref));
+	ref->rr_record = r;
+	ref->rr_next = hash[h];
+	hash[h] = ref;
+}
+
+static void record_unhash(struct history_record *r)
+{
+	struct record_ref **ref, *old;
+
+	for (ref = &hash[key_hash(r->hr_key)]; *ref; ref = &(*ref)->rr_next) {
+		if ((*ref)->rr_record == r) {
+			old = *ref;
+			*ref = old->rr_next;
+			xfree(old);
+			return;
+		}
+	}
+}
+
+static void hash_flush(void)
+{
+	struct record_ref *ref, *next;
+	int i;
+
+	for (i = 0; i < HISTORY_FILE_HASH; i++) {
+		for (ref = hash[i]; ref; ref = next) {
+			next = ref->rr_next;
+			xfree(ref);
+		}
+		hash[i] = NULL;
+	}
+}
+
+static int record_matches(struct history_record *r, struct history_def *def)
+{
+	return r->hr_ring_size == def->hd_ring_size &&
+	       r->hr_type == def->hd_type &&
+	       r->hr_size == def->hd_size &&
+	       r->hr_values == def->hd_values &&
+	       r->hr_interval == def->hd_interval;
+}
+
+/* detached record of history with a ring of the same layout */
+static struct history_record *record_lookup(struct history *h)
+{
+	struct history_record *r;
+	struct record_ref *ref;
+
+	for (ref = hash[key_hash(h->h_key)]; ref; ref = ref->rr_next) {
+		r = ref->rr_record;
+
+		if (!strcmp(r->hr_key, h->h_key) &&
+		    !(r->hr_flags & RECORD_FLAG_ATTACHED) &&
+		    record_matches(r, h->h_definition))
+			return r;
+	}
+
+	return NULL;
+}
+
+static void hdr_init(uint64_t size)
+{
+	memset(hdr, 0, sizeof(*hdr));
+	memcpy(hdr->hf_magic, HISTORY_FILE_MAGIC, sizeof(hdr->hf_magic));
+	hdr->hf_version = HISTORY_FILE_VERSION;
+	hdr->hf_hdr_len = sizeof(*hdr);
+	hdr->hf_size = size;
+	hdr->hf_used = sizeof(*hdr);
+}
+
+/*
+ * Index all records of the file. Returns -1 if a record is corrupt in
+ * which case the file is started over.
+ */
+static int hdr_scan(void)
+{
+	struct history_record *r;
+	uint64_t off;
+
+	if (hdr->hf_used < sizeof(*hdr) || hdr->hf_used > hdr->hf_size)
+		return -1;
+
+	for (off = sizeof(*hdr); off < hdr->hf_used; off += r->hr_len) {
+		r = record_at(off);
+
+		if (r->hr_len < sizeof(*r) || r->hr_len % sizeof(uint64_t) ||
+		    off + r->hr_len > hdr->hf_used ||
+		    r->hr_len - sizeof(*r) < r->hr_ring_size ||
+		    r->hr_index < 0 || r->hr_index >= r->hr_size ||
+		    memchr(r->hr_key, '\0', sizeof(r->hr_key)) == NULL)
+			return -1;
+
+		r->hr_flags &= ~RECORD_FLAG_ATTACHED;
+		record_hash(r);
+	}
+
+	return 0;
+}
+
+/**
+ * Open history file
+ * @arg path		Path to history file
+ * @arg size		Minimal size of file in bytes
+ * @arg interval	Seconds between syncs
+ *
+ * Maps the history file, creating or extending it as needed. A file
+ * of another version is started over, a non-empty file which is not a
+ * history file is refused. If another process holds the file, history
+ * is kept in memory.
+ */
+void history_file_open(const char *path, size_t size, float interval)
+{
+	struct history_file_hdr old;
+	struct stat st;
+	int fd, valid = 0;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0 ||
+	    fstat(fd, &st) < 0)
+		quit("Unable to open history file %s: %s\n",
+		     path, strerror(errno));
+
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0) {
+		xwarn("History file %s is in use (%s), keeping history "
+		      "in memory\n", path, strerror(errno));
+		close(fd);
+		return;
+	}
+
+	if (st.st_size > 0) {
+		if (pread(fd, &old, sizeof(old), 0) != sizeof(old) ||
+		    memcmp(old.hf_magic, HISTORY_FILE_MAGIC,
+			   sizeof(old.hf_magic)))
+			quit("%s is not a bmon history file, refusing to "
+			     "overwrite it\n", path);
+
+		if (old.hf_version == HISTORY_FILE_VERSION &&
+		    old.hf_hdr_len == sizeof(old))
+			valid = 1;
+		else
+			xwarn("History file %s has version %u, starting "
+			      "over\n", path, old.hf_version);
+	}
+
+	/* never shrink a file which is in use */
+	if (valid && old.hf_size > size && old.hf_size <= st.st_size)
+		size = old.hf_size;
+
+	size = (size + sizeof(uint64_t) - 1) & ~(sizeof(uint64_t) - 1);
+	if (size < sizeof(*hdr))
+		size = sizeof(*hdr);
+
+	if (st.st_size < size && ftruncate(fd, size) < 0)
+		quit("Unable to resize history file %s: %s\n",
+		     path, strerror(errno));
+
+	hdr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (hdr == MAP_FAILED)
+		quit("Unable to map history file %s: %s\n",
+		     path, strerror(errno));
+
+	/* the lock is held for as long as the file is mapped */
+	lock_fd = fd;
+
+	if (valid) {
+		hdr->hf_size = size;
+
+		if (hdr_scan() < 0) {
+			xwarn("History file %s is corrupt, starting over\n",
+			      path);
+			hash_flush();
+			valid = 0;
+		}
+	}
+
+	if (!valid)
+		hdr_init(size);
+
+	sync_interval = interval;
+	last_sync = wall_clock();
+}
+
+size_t history_file_size(void)
+{
+	return hdr ? hdr->hf_size : 0;
+}
+
+static void record_save(struct history *h, double now)
+{
+	struct history_record *r = h->h_record;
+
+	r->hr_index = h->h_index;
+	r->hr_saved = now;
+}
+
+/**
+ * Reattach history to its record
+ * @arg h		History with h_key set
+ * @arg age		Seconds since the record was last saved
+ *
+ * A record only matches if its ring has the layout of the definition.
+ *
+ * @return Ring of the record or NULL if no matching record exists.
+ */
+void *history_file_attach(struct history *h, double *age)
+{
+	struct history_record *r;
+
+	if (!hdr || !(r = record_lookup(h)))
+		return NULL;
+
+	r->hr_flags |= RECORD_FLAG_ATTACHED;
+	h->h_record = r;
+	h->h_index = r->hr_index;
+	list_add_tail(&h->h_file_list, &attached);
+
+	*age = wall_clock() - r->hr_saved;
+	if (*age < 0)
+		*age = 0;
+
+	return r->hr_data;
+}
+
+/*
+ * Reuse the record of equal size which has been saved the longest time
+ * ago and is not attached.
+ */
+static struct history_record *record_reuse(uint32_t len)
+{
+	struct history_record *r, *best = NULL;
+	uint64_t off;
+
+	for (off = sizeof(*hdr); off < hdr->hf_used; off += r->hr_len) {
+		r = record_at(off);
+
+		if (r->hr_len != len || r->hr_flags & RECORD_FLAG_ATTACHED)
+			continue;
+
+		if (!best || r->hr_saved < best->hr_saved)
+			best = r;
+	}
+
+	if (best)
+		record_unhash(best);
+
+	return best;
+}
+
+/**
+ * Allocate a record for history
+ * @arg h		History with h_key set
+ *
+ * @return Zeroed ring or NULL if the file is full.
+ */
+void *history_file_alloc(struct history *h)
+{
+	struct history_def *def = h->h_definition;
+	struct history_record *r;
+	uint32_t len;
+
+	if (!hdr)
+		return NULL;
+
+	len = sizeof(*r) + def->hd_ring_size;
+
+	if (hdr->hf_used + len <= hdr->hf_size) {
+		r = record_at(hdr->hf_used);
+		hdr->hf_used += len;
+	} else if (!(r = record_reuse(len)))
+		return NULL;
+
+	memset(r, 0, len);
+	r->hr_len = len;
+	r->hr_flags = RECORD_FLAG_ATTACHED;
+	r->hr_ring_size = def->hd_ring_size;
+	r->hr_type = def->hd_type;
+	r->hr_size = def->hd_size;
+	r->hr_values = def->hd_values;
+	r->hr_interval = def->hd_interval;
+	strncpy(r->hr_key, h->h_key, sizeof(r->hr_key) - 1);
+	record_hash(r);
+
+	h->h_record = r;
+	list_add_tail(&h->h_file_list, &attached);
+	record_save(h, wall_clock());
+
+	return r->hr_data;
+}
+
+/**
+ * Detach history from its record
+ * @arg h		History
+ *
+ * The record keeps the history for a later reattach.
+ */
+void history_file_detach(struct history *h)
+{
+	struct history_record *r = h->h_record;
+
+	if (!r)
+		return;
+
+	record_save(h, wall_clock());
+	r->hr_flags &= ~RECORD_FLAG_ATTACHED;
+
+	list_del(&h->h_file_list);
+	h->h_record = NULL;
+}
+
+/**
+ * Sync history file
+ * @arg force		Sync even if the sync interval has not passed
+ *
+ * Saves the state of all attached histories and schedules the file to
+ * be written back.
+ */
+void history_file_sync(int force)
+{
+	struct history *h;
+	double now;
+
+	if (!hdr)
+		return;
+
+	now = wall_clock();
+
+	if (!force && now - last_sync < sync_interval)
+		return;
+
+	list_for_each_entry(h, &attached, h_file_list)
+		record_save(h, now);
+
+	hdr->hf_saved = now;
+	last_sync = now;
+
+	msync(hdr, hdr->hf_size, force ? MS_SYNC : MS_ASYNC);
+}
+
+void history_file_close(void)
+{
+	if (!hdr)
+		return;
+
+	msync(hdr, hdr->hf_size, MS_SYNC);
+	munmap(hdr, hdr->hf_size);
+	hdr = NULL;
+
+	close(lock_fd);
+	lock_fd = -1;
+
+	hash_flush();
+}
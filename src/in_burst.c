@@ -0,0 +1,597 @@
+/*
+ * in_burst.c		Microburst Sampler
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/input.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/attr.h>
+#include <bmon/unit.h>
+#include <bmon/utils.h>
+#include <bmon/readbatch.h>
+
+#if defined SYS_LINUX && defined HAVE_PTHREAD
+
+#include <pthread.h>
+#include <signal.h>
+
+/*
+ * The sampler thread reads the byte and packet counters of the selected
+ * links from sysfs every few milliseconds and reduces each second to
+ * the peak rate, the 99th percentile rate and a histogram of the rates
+ * relative to the mean rate of that second. The summaries are handed
+ * to the main loop which publishes them as attributes of the elements
+ * created by the primary input, their history is collected like for
+ * any other attribute.
+ *
+ * The thread owns everything it samples, only the summary of a link is
+ * shared and protected by the link's lock. If the main loop does not
+ * pick up a summary in time, the next second is merged into it.
+ */
+
+enum {
+	BURST_BYTES,
+	BURST_PACKETS,
+	__BURST_MAX,
+};
+
+/* histogram buckets: <1x, 1-2x, 2-4x, 4-8x, 8-16x, >=16x the mean rate */
+#define BURST_HIST		6
+
+static const char *stat_files[__BURST_MAX][2] = {
+	[BURST_BYTES]	= { "rx_bytes", "tx_bytes" },
+	[BURST_PACKETS]	= { "rx_packets", "tx_packets" },
+};
+
+static struct {
+	const char *	name;
+	const char *	description;
+	const char *	unit;
+	int		attrid;
+} burst_attrs[] = {
+	{ "bytes_peak",		"Peak Bytes",		"byte" },
+	{ "bytes_p99",		"99th Pct Bytes",	"byte" },
+	{ "packets_peak",	"Peak Packets",		"number" },
+	{ "packets_p99",	"99th Pct Packets",	"number" },
+	{ "burst_lt1",		"Bursts <1x Mean",	"number" },
+	{ "burst_1x",		"Bursts 1-2x Mean",	"number" },
+	{ "burst_2x",		"Bursts 2-4x Mean",	"number" },
+	{ "burst_4x",		"Bursts 4-8x Mean",	"number" },
+	{ "burst_8x",		"Bursts 8-16x Mean",	"number" },
+	{ "burst_16x",		"Bursts >=16x Mean",	"number" },
+};
+
+#define ATTR_PEAK(n)		(2 * (n))
+#define ATTR_P99(n)		(2 * (n) + 1)
+#define ATTR_HIST(n)		(2 * __BURST_MAX + (n))
+
+struct burst_summary
+{
+	float			bs_peak[__BURST_MAX][2];
+	float			bs_p99[__BURST_MAX][2];
+	/* number of byte rate samples per bucket */
+	uint32_t		bs_hist[BURST_HIST][2];
+	int			bs_valid;
+};
+
+struct burst_link
+{
+	char *			bl_name;
+	int			bl_fd[__BURST_MAX][2];
+	char			bl_buf[__BURST_MAX][2][32];
+	int			bl_failed;
+
+	/* counters of the previous sample, valid if bl_have_prev */
+	uint64_t		bl_prev[__BURST_MAX][2];
+	int			bl_have_prev;
+
+	/* rates of all samples of the current second */
+	float *			bl_rates[__BURST_MAX][2];
+	unsigned int		bl_nrates;
+	uint64_t		bl_delta[__BURST_MAX][2];
+	uint64_t		bl_elapsed;
+
+	pthread_mutex_t		bl_lock;
+	struct burst_summary	bl_summary;
+
+	struct list_head	bl_list;
+};
+
+static const char *c_dir = "/sys";
+static const char *c_group = DEFAULT_GROUP;
+static float c_interval = 0.005f;
+static int c_backend = READ_BACKEND_PREAD;
+
+static LIST_HEAD(link_list);
+static struct element_group *grp;
+static struct read_batch batch;
+static unsigned int max_rates;
+
+static struct bmon_module burst_ops;
+
+static pthread_t sampler;
+static int running;
+static volatile int stopping;
+
+static uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+
+	/*
+	 * Not the clock source, the sampler must run on real time even
+	 * if the main loop is driven by a simulated clock.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t parse_u64(const char *buf, ssize_t len)
+{
+	uint64_t val = 0;
+	ssize_t i;
+
+	for (i = 0; i < len && buf[i] >= '0' && buf[i] <= '9'; i++)
+		val = val * 10 + (buf[i] - '0');
+
+	return val;
+}
+
+static void link_open(struct burst_link *l)
+{
+	char path[FILENAME_MAX];
+	int i, j;
+
+	for (i = 0; i < __BURST_MAX; i++) {
+		for (j = 0; j < 2; j++) {
+			if (l->bl_fd[i][j] >= 0)
+				close(l->bl_fd[i][j]);
+
+			snprintf(path, sizeof(path),
+				 "%s/class/net/%s/statistics/%s",
+				 c_dir, l->bl_name, stat_files[i][j]);
+
+			l->bl_fd[i][j] = open(path, O_RDONLY | O_CLOEXEC);
+		}
+	}
+
+	l->bl_failed = 0;
+	l->bl_have_prev = 0;
+}
+
+static void link_add(const char *name)
+{
+	struct burst_link *l;
+	int i, j;
+
+	l = xcalloc(1, sizeof(*l));
+	l->bl_name = strdup(name);
+
+	for (i = 0; i < __BURST_MAX; i++)
+		for (j = 0; j < 2; j++)
+			l->bl_fd[i][j] = -1;
+
+	pthread_mutex_init(&l->bl_lock, NULL);
+	list_add_tail(&l->bl_list, &link_list);
+}
+
+static void link_free(struct burst_link *l)
+{
+	int i, j;
+
+	for (i = 0; i < __BURST_MAX; i++) {
+		for (j = 0; j < 2; j++) {
+			if (l->bl_fd[i][j] >= 0)
+				close(l->bl_fd[i][j]);
+			xfree(l->bl_rates[i][j]);
+		}
+	}
+
+	pthread_mutex_destroy(&l->bl_lock);
+	list_del(&l->bl_list);
+	xfree(l->bl_name);
+	xfree(l);
+}
+
+static int cmp_float(const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+
+	return (x > y) - (x < y);
+}
+
+static int hist_bucket(float rate, float mean)
+{
+	int n;
+
+	if (rate < mean || mean <= 0.0f)
+		return 0;
+
+	for (n = 1; n < BURST_HIST - 1 && rate >= 2.0f * mean; n++)
+		mean *= 2.0f;
+
+	return n;
+}
+
+/* reduce the samples of the past second and hand them to the main loop */
+static void link_summarise(struct burst_link *l)
+{
+	struct burst_summary s;
+	struct burst_summary *p = &l->bl_summary;
+	unsigned int n = l->bl_nrates;
+	float *rates, mean;
+	int i, j, k;
+
+	if (!n)
+		return;
+
+	memset(&s, 0, sizeof(s));
+
+	for (i = 0; i < __BURST_MAX; i++) {
+		for (j = 0; j < 2; j++) {
+			rates = l->bl_rates[i][j];
+
+			mean = l->bl_elapsed ? l->bl_delta[i][j] * 1e9f /
+					       l->bl_elapsed : 0.0f;
+
+			if (i == BURST_BYTES) {
+				for (k = 0; k < n; k++) {
+					int b = hist_bucket(rates[k], mean);
+
+					s.bs_hist[b][j]++;
+				}
+			}
+
+			qsort(rates, n, sizeof(float), cmp_float);
+
+			s.bs_peak[i][j] = rates[n - 1];
+			s.bs_p99[i][j] = rates[(n * 99 + 99) / 100 - 1];
+
+			l->bl_delta[i][j] = 0;
+		}
+	}
+
+	l->bl_nrates = 0;
+	l->bl_elapsed = 0;
+
+	pthread_mutex_lock(&l->bl_lock);
+
+	if (!p->bs_valid)
+		*p = s;
+	else {
+		for (i = 0; i < __BURST_MAX; i++) {
+			for (j = 0; j < 2; j++) {
+				if (s.bs_peak[i][j] > p->bs_peak[i][j])
+					p->bs_peak[i][j] = s.bs_peak[i][j];
+				if (s.bs_p99[i][j] > p->bs_p99[i][j])
+					p->bs_p99[i][j] = s.bs_p99[i][j];
+			}
+		}
+
+		for (k = 0; k < BURST_HIST; k++)
+			for (j = 0; j < 2; j++)
+				p->bs_hist[k][j] += s.bs_hist[k][j];
+	}
+
+	p->bs_valid = 1;
+
+	pthread_mutex_unlock(&l->bl_lock);
+}
+
+/*
+ * Consumes the results of the requests queued for the link starting at
+ * *req and advances it past them.
+ */
+static void link_sample(struct burst_link *l, unsigned int *req,
+			uint64_t elapsed)
+{
+	uint64_t val[__BURST_MAX][2];
+	int i, j, failed = 0;
+
+	for (i = 0; i < __BURST_MAX; i++) {
+		for (j = 0; j < 2; j++) {
+			struct read_req *r;
+
+			if (l->bl_fd[i][j] < 0) {
+				failed = 1;
+				continue;
+			}
+
+			r = &batch.rb_reqs[(*req)++];
+
+			if (r->rr_res <= 0)
+				failed = 1;
+			else
+				val[i][j] = parse_u64(l->bl_buf[i][j], r->rr_res);
+		}
+	}
+
+	if (failed) {
+		l->bl_failed = 1;
+		l->bl_have_prev = 0;
+		return;
+	}
+
+	if (l->bl_have_prev && elapsed && l->bl_nrates < max_rates) {
+		for (i = 0; i < __BURST_MAX; i++) {
+			for (j = 0; j < 2; j++) {
+				/* counters may be reset, e.g. by a driver reload */
+				uint64_t d = val[i][j] >= l->bl_prev[i][j] ?
+					     val[i][j] - l->bl_prev[i][j] : 0;
+
+				l->bl_rates[i][j][l->bl_nrates] =
+					d * 1e9f / elapsed;
+				l->bl_delta[i][j] += d;
+			}
+		}
+
+		l->bl_nrates++;
+		l->bl_elapsed += elapsed;
+	}
+
+	memcpy(l->bl_prev, val, sizeof(val));
+	l->bl_have_prev = 1;
+}
+
+static void *sampler_run(void *arg)
+{
+	uint64_t interval, next, last = 0, second, now;
+	struct burst_link *l;
+	struct timespec ts;
+	unsigned int req;
+	int i, j;
+
+	interval = c_interval * 1000000000ULL;
+	next = monotonic_ns();
+	second = next + 1000000000ULL;
+
+	while (!stopping) {
+		read_batch_reset(&batch);
+
+		list_for_each_entry(l, &link_list, bl_list)
+			for (i = 0; i < __BURST_MAX; i++)
+				for (j = 0; j < 2; j++)
+					if (l->bl_fd[i][j] >= 0)
+						read_batch_add(&batch,
+							l->bl_fd[i][j],
+							l->bl_buf[i][j],
+							sizeof(l->bl_buf[i][j]));
+
+		read_batch_submit(&batch);
+		now = monotonic_ns();
+
+		req = 0;
+		list_for_each_entry(l, &link_list, bl_list)
+			link_sample(l, &req, last ? now - last : 0);
+		last = now;
+
+		if (now >= second) {
+			list_for_each_entry(l, &link_list, bl_list) {
+				link_summarise(l);
+
+				/* the link may have been recreated */
+				if (l->bl_failed)
+					link_open(l);
+			}
+
+			do {
+				second += 1000000000ULL;
+			} while (second <= now);
+		}
+
+		/* skip all deadlines which have already passed */
+		do {
+			next += interval;
+		} while (next <= now);
+
+		ts.tv_sec = next / 1000000000ULL;
+		ts.tv_nsec = next % 1000000000ULL;
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &ts, NULL) == EINTR && !stopping);
+	}
+
+	return NULL;
+}
+
+static void publish(struct burst_link *l, struct burst_summary *s)
+{
+	struct element *e;
+	struct attr *a;
+	int i, k;
+
+	if (!(e = element_find(grp, l->bl_name, 0, NULL)))
+		return;
+
+	for (i = 0; i < __BURST_MAX; i++) {
+		attr_update(e, burst_attrs[ATTR_PEAK(i)].attrid,
+			    s->bs_peak[i][0], s->bs_peak[i][1],
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		attr_update(e, burst_attrs[ATTR_P99(i)].attrid,
+			    s->bs_p99[i][0], s->bs_p99[i][1],
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+	}
+
+	for (k = 0; k < BURST_HIST; k++)
+		attr_update(e, burst_attrs[ATTR_HIST(k)].attrid,
+			    s->bs_hist[k][0], s->bs_hist[k][1],
+			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+
+	/*
+	 * Only notify the attributes updated here, the others belong to
+	 * the primary input which notifies them itself.
+	 */
+	for (i = 0; i < ARRAY_SIZE(burst_attrs); i++)
+		if ((a = attr_lookup(e, burst_attrs[i].attrid)))
+			attr_notify_update(e, a, input_timestamp());
+}
+
+static void burst_read(void)
+{
+	struct burst_summary s;
+	struct burst_link *l;
+
+	list_for_each_entry(l, &link_list, bl_list) {
+		pthread_mutex_lock(&l->bl_lock);
+		s = l->bl_summary;
+		l->bl_summary.bs_valid = 0;
+		pthread_mutex_unlock(&l->bl_lock);
+
+		if (s.bs_valid)
+			publish(l, &s);
+	}
+}
+
+static void burst_do_init(void)
+{
+	struct burst_link *l;
+	sigset_t all, old;
+	struct unit *u;
+	int i, j, err;
+
+	if (!(burst_ops.m_flags & BMON_MODULE_ENABLED))
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(burst_attrs); i++) {
+		if (!(u = unit_lookup(burst_attrs[i].unit)))
+			BUG();
+
+		burst_attrs[i].attrid = attr_def_add(burst_attrs[i].name,
+						     burst_attrs[i].description,
+						     u, ATTR_TYPE_RATE,
+						     ATTR_DEF_FLAG_HISTORY);
+	}
+
+	if (!(grp = group_lookup(c_group, GROUP_CREATE)))
+		BUG();
+
+	/* one sample per interval plus slack for a late summary */
+	max_rates = 1.0f / c_interval + 2;
+
+	list_for_each_entry(l, &link_list, bl_list) {
+		for (i = 0; i < __BURST_MAX; i++)
+			for (j = 0; j < 2; j++)
+				l->bl_rates[i][j] = xcalloc(max_rates,
+							    sizeof(float));
+
+		link_open(l);
+	}
+
+	read_batch_init(&batch, c_backend);
+
+	/* signals are handled by the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&sampler, NULL, sampler_run, NULL);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (err)
+		quit("burst: Unable to start sampler: %s\n", strerror(err));
+
+	running = 1;
+}
+
+static void burst_shutdown(void)
+{
+	struct burst_link *l, *n;
+
+	if (running) {
+		stopping = 1;
+		pthread_join(sampler, NULL);
+		running = 0;
+		read_batch_exit(&batch);
+	}
+
+	list_for_each_entry_safe(l, n, &link_list, bl_list)
+		link_free(l);
+}
+
+static void print_help(void)
+{
+	printf(
+	"burst - Microburst sampler for Linux\n" \
+	"\n" \
+	"  Samples the byte and packet counters of the selected links at a\n" \
+	"  high rate in a separate thread and summarises every second into\n" \
+	"  the peak and 99th percentile rate plus a histogram of the byte\n" \
+	"  rates relative to the mean rate of that second. The summaries\n" \
+	"  are added as attributes to the links of the primary input.\n" \
+	"  Author: Thomas Graf <tgraf@suug.ch>\n" \
+	"\n" \
+	"  Options:\n" \
+	"    dev=NAME       Link to sample, may be given multiple times\n" \
+	"    interval=SECS  Sampling interval, 0.001-0.1 (default: 0.005)\n" \
+	"    dir=DIR        Sysfs directory (default: /sys)\n" \
+	"    group=NAME     Group of the links (default: intf)\n" \
+	"    io=BACKEND     Read backend, pread or uring (default: pread)\n" \
+	"\n" \
+	"  Example: -I 'burst:dev=eth0;dev=eth1;interval=0.001'\n");
+}
+
+static void burst_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "dev") && value)
+		link_add(value);
+	else if (!strcasecmp(type, "interval") && value) {
+		c_interval = strtod(value, NULL);
+		if (c_interval < 0.001f || c_interval > 0.1f)
+			quit("burst: Interval must be within 0.001-0.1\n");
+	} else if (!strcasecmp(type, "dir") && value)
+		c_dir = value;
+	else if (!strcasecmp(type, "group") && value)
+		c_group = value;
+	else if (!strcasecmp(type, "io") && value) {
+		if ((c_backend = read_backend_lookup(value)) < 0)
+			quit("Unknown read backend \"%s\"\n", value);
+	}
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static int burst_probe(void)
+{
+	if (list_empty(&link_list))
+		quit("burst: No links selected, use dev=NAME\n");
+
+	return 1;
+}
+
+static struct bmon_module burst_ops = {
+	.m_name		= "burst",
+	.m_type		= BMON_SECONDARY_MODULE,
+	.m_do		= burst_read,
+	.m_shutdown	= burst_shutdown,
+	.m_parse_opt	= burst_parse_opt,
+	.m_probe	= burst_probe,
+	.m_init		= burst_do_init,
+};
+
+static void __init burst_init(void)
+{
+	input_register(&burst_ops);
+}
+
+#endif
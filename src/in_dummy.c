@@ -27,10 +27,9 @@
 #include <bmon/group.h>
 #include <bmon/element.h>
 #include <bmon/attr.h>
+#include <bmon/unit.h>
 #include <bmon/utils.h>
 
-#define MAXDEVS 32
-
 static uint64_t c_rx_b_inc = 1000000000;
 static uint64_t c_tx_b_inc = 80000000;
 static uint64_t c_rx_p_inc = 1000;
@@ -40,80 +39,100 @@ static int c_randomize = 0;
 static int c_mtu = 1540;
 static int c_maxpps = 100000;
 static int c_numgroups = 2;
+static int c_depth = 0;
+static int c_children = 4;
+static int c_numattrs = 2;
+
+static struct element_group **groups;
+static struct attr_batch batch;
 
+/* cnts[element][direction][attr], elements in read order */
 static uint64_t *cnts;
+static unsigned int nelements;
+
+static unsigned int elements_per_dev(void)
+{
+	unsigned int n = 1, level = 1;
+	int i;
+
+	for (i = 0; i < c_depth; i++) {
+		level *= c_children;
+		n += level;
+	}
 
-/* cnts[ngroups][ndevs][2][2] */
+	return n;
+}
 
-static inline int cnt_size(void)
+static void update_counters(uint64_t *rx, uint64_t *tx)
 {
-	return c_numgroups * c_numdev * 2 * 2;
+	int i;
+
+	if (c_randomize) {
+		uint64_t rxp = rand() % c_maxpps;
+		uint64_t txp = rand() % c_maxpps;
+
+		rx[0] += rxp;
+		tx[0] += txp;
+		rx[1] += rxp * (rand() % c_mtu);
+		tx[1] += txp * (rand() % c_mtu);
+	} else {
+		rx[0] += c_rx_p_inc;
+		tx[0] += c_tx_p_inc;
+		rx[1] += c_rx_b_inc;
+		tx[1] += c_tx_b_inc;
+	}
+
+	/* additional attributes follow the packet counters */
+	for (i = 2; i < c_numattrs; i++) {
+		rx[i] += rx[0] & 0xff;
+		tx[i] += tx[0] & 0xff;
+	}
 }
 
-static inline uint64_t *cnt(int group, int dev, int unit,
-			   int direction)
+static void read_element(struct element_group *group, struct element *parent,
+			 const char *name, int level, unsigned int *idx)
 {
-	return cnts + (group * c_numdev * 2 * 2) +
-		      (dev * 2 * 2) +
-		      (unit * 2) +
-		      direction;
+	uint64_t *rx = cnts + (*idx)++ * c_numattrs * 2;
+	uint64_t *tx = rx + c_numattrs;
+	struct element *e;
+	int i;
+
+	if (!(e = element_lookup(group, name, 0, parent)))
+		return;
+
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+		element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
+		element_set_usage_attr(e, ATTR_BYTES);
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
+
+	update_counters(rx, tx);
+	attr_update_batch(e, &batch, rx, tx, ATTR_BATCH_ALL);
+
+	element_notify_update(e, NULL);
+	element_lifesign(e, 1);
+
+	if (level < c_depth) {
+		for (i = 0; i < c_children; i++) {
+			char child[32];
+
+			snprintf(child, sizeof(child), "sub%d", i);
+			read_element(group, e, child, level + 1, idx);
+		}
+	}
 }
 
 static void dummy_read(void)
 {
+	unsigned int idx = 0;
 	int gidx, n;
 
 	for (gidx = 0; gidx < c_numgroups; gidx++) {
-		char gname[32];
-		struct element_group *group;
-
-		snprintf(gname, sizeof(gname), "group%02d", gidx);
-		group = group_lookup(gname, GROUP_CREATE);
-
 		for (n = 0; n < c_numdev; n++) {
 			char ifname[IFNAMSIZ];
-			struct element *e;
 
 			snprintf(ifname, sizeof(ifname), "dummy%d", n);
-
-			if (!(e = element_lookup(group, ifname, 0, NULL)))
-				return;
-
-			if (e->e_flags & ELEMENT_FLAG_UPDATED)
-				continue;
-
-			/* FIXME: DONT DO THIS ON EVERY READ */
-			element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
-			element_set_usage_attr(e, ATTR_BYTES);
-
-			if (c_randomize) {
-				uint64_t rx = rand() % c_maxpps;
-				uint64_t tx = rand() % c_maxpps;
-
-				*cnt(gidx, n, 0, 0) += rx;
-				*cnt(gidx, n, 0, 1) += tx;
-				*cnt(gidx, n, 1, 0) += rx * (rand() % c_mtu);
-				*cnt(gidx, n, 1, 1) += tx * (rand() % c_mtu);
-			} else {
-				*cnt(gidx, n, 0, 0) += c_rx_p_inc;
-				*cnt(gidx, n, 0, 1) += c_tx_p_inc;
-				*cnt(gidx, n, 1, 0) += c_rx_b_inc;
-				*cnt(gidx, n, 1, 1) += c_tx_b_inc;
-			}
-
-			attr_update(e, ATTR_PACKETS,
-				    *cnt(gidx, n, 0, 0),
-				    *cnt(gidx, n, 0, 1),
-				    UPDATE_FLAG_RX | UPDATE_FLAG_TX |
-				    UPDATE_FLAG_64BIT);
-			attr_update(e, ATTR_BYTES,
-				    *cnt(gidx, n, 1, 0),
-				    *cnt(gidx, n, 1, 1),
-				    UPDATE_FLAG_RX | UPDATE_FLAG_TX |
-				    UPDATE_FLAG_64BIT);
-
-			element_notify_update(e, NULL);
-			element_lifesign(e, 1);
+			read_element(groups[gidx], NULL, ifname, 0, &idx);
 		}
 	}
 }
@@ -134,6 +153,9 @@ static void print_help(void)
 	"    txp=NUM        TX packets increment amount (default: 800)\n" \
 	"    num=NUM        Number of devices (default: 5)\n" \
 	"    numgroups=NUM  Number of groups (default: 2)\n" \
+	"    depth=NUM      Levels of child elements per device (default: 0)\n" \
+	"    children=NUM   Number of children per element (default: 4)\n" \
+	"    attrs=NUM      Number of attributes per element (default: 2, max: 64)\n" \
 	"    randomize      Randomize counters (default: off)\n" \
 	"    seed=NUM       Seed for randomizer (default: time(0))\n" \
 	"    mtu=NUM        Maximal Transmission Unit (default: 1540)\n" \
@@ -146,7 +168,7 @@ static void print_help(void)
 	"    TX-bytes   := TX-packets * (Rand() %% mtu)\n");
 }
 
-static void dummy_parse_opt(const char *value, const char *type)
+static void dummy_parse_opt(const char *type, const char *value)
 {
 	if (!strcasecmp(type, "rxb") && value)
 		c_rx_b_inc = strtol(value, NULL, 0);
@@ -169,30 +191,75 @@ static void dummy_parse_opt(const char *value, const char *type)
 		c_maxpps = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "numgroups") && value)
 		c_numgroups = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "depth") && value)
+		c_depth = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "children") && value)
+		c_children = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "attrs") && value)
+		c_numattrs = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "help")) {
 		print_help();
 		exit(0);
 	}
 }
 
-static int dummy_probe(void)
+static void dummy_do_init(void)
 {
-	int i;
+	struct unit *byte, *number;
+	int i, id, flags = UPDATE_FLAG_RX | UPDATE_FLAG_TX;
 
-	if (c_numdev >= MAXDEVS) {
-		fprintf(stderr, "numdev must be in rage 0..%d\n", MAXDEVS);
-		return 0;
+	if (!(byte = unit_lookup("byte")) || !(number = unit_lookup("number")))
+		BUG();
+
+	id = attr_def_add("packets", "Packets", number, ATTR_TYPE_COUNTER, 0);
+	attr_batch_add(&batch, id, flags);
+	id = attr_def_add("bytes", "Bytes", byte, ATTR_TYPE_COUNTER, 0);
+	attr_batch_add(&batch, id, flags);
+
+	for (i = 2; i < c_numattrs; i++) {
+		char name[32];
+
+		snprintf(name, sizeof(name), "dummy%02d", i);
+		id = attr_def_add(name, name, number, ATTR_TYPE_COUNTER, 0);
+		attr_batch_add(&batch, id, flags);
 	}
 
-	cnts = xcalloc(cnt_size(), sizeof(uint64_t));
+	groups = xcalloc(c_numgroups, sizeof(*groups));
 
 	for (i = 0; i < c_numgroups; i++) {
 		char groupname[32];
-		snprintf(groupname, sizeof(groupname), "group%02d", i);
 
+		snprintf(groupname, sizeof(groupname), "group%02d", i);
 		group_new_derived_hdr(groupname, groupname, DEFAULT_GROUP);
+
+		if (!(groups[i] = group_lookup(groupname, GROUP_CREATE)))
+			BUG();
 	}
 
+	nelements = c_numgroups * c_numdev * elements_per_dev();
+	cnts = xcalloc(nelements * c_numattrs * 2, sizeof(uint64_t));
+}
+
+static void dummy_shutdown(void)
+{
+	xfree(cnts);
+	xfree(groups);
+}
+
+static int dummy_probe(void)
+{
+	if (c_numdev < 0 || c_numgroups < 0 || c_depth < 0 ||
+	    c_children < 0) {
+		fprintf(stderr, "num, numgroups, depth and children must " \
+			"not be negative\n");
+		return 0;
+	}
+
+	if (c_numattrs < 2)
+		c_numattrs = 2;
+	else if (c_numattrs > ATTR_BATCH_MAX)
+		c_numattrs = ATTR_BATCH_MAX;
+
 	return 1;
 }
 
@@ -200,6 +267,8 @@ static struct bmon_module dummy_ops = {
 	.m_name		= "dummy",
 	.m_type		= BMON_PRIMARY_MODULE,
 	.m_do		= dummy_read,
+	.m_init		= dummy_do_init,
+	.m_shutdown	= dummy_shutdown,
 	.m_parse_opt	= dummy_parse_opt,
 	.m_probe	= dummy_probe,
 	.m_flags	= BMON_MODULE_NO_DEFAULT,
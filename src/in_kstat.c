@@ -74,6 +74,7 @@ static void kstat_attr_update(kstat_t *kst, struct element *e, int attr,
 static void kstat_read_interface(kstat_t *kst)
 {
 	struct element *e;
+	timestamp_t ts;
 
 	/* group is cached */
 	if (!grp || grp_instance != kst->ks_instance) {
@@ -103,7 +104,14 @@ static void kstat_read_interface(kstat_t *kst)
 	//kstat_attr_update(kst, e, ATTR_BROADCAST, 0, 0, brdcstrcv, brdcstxmt);
 	kstat_attr_update(kst, e, ATTR_COLLISIONS, NULL, "colissions");
 
-	element_notify_update(e, NULL);
+	/*
+	 * ks_snaptime is taken from gethrtime() which is what
+	 * CLOCK_MONOTONIC is based on as well.
+	 */
+	ts.tv_sec = kst->ks_snaptime / 1000000000LL;
+	ts.tv_usec = (kst->ks_snaptime % 1000000000LL) / 1000;
+
+	element_notify_update(e, &ts);
 	element_lifesign(e, 1);
 }
 
@@ -31,12 +31,16 @@
 #include <bmon/utils.h>
 
 static int c_notc = 0;
+static int c_events = 0;
+static int c_ipv6 = 0;
+static int use_getstats = 1;
 static const char *c_group = DEFAULT_GROUP;
 static struct element_group *grp;
 
 #include <netlink/netlink.h>
 #include <netlink/cache.h>
 #include <netlink/utils.h>
+#include <netlink/route/rtnl.h>
 #include <netlink/route/link.h>
 #include <netlink/route/tc.h>
 #include <netlink/route/qdisc.h>
@@ -156,40 +160,214 @@ struct attr_map tc_attrs[] = {
 struct rdata {
 	struct element *	parent;
 	int 			level;
+	int			ifindex;
 };
 
-static struct nl_sock *sock;
-static struct nl_cache *link_cache, *qdisc_cache, *class_cache;
+#define TC_INDEX_SIZE 256
+
+/*
+ * Traffic control objects of the link currently being processed,
+ * hashed by (ifindex, parent handle) so the tree can be walked
+ * without scanning the caches for the children of every node.
+ */
+struct tc_index {
+	struct list_head	ti_hash[TC_INDEX_SIZE];
+};
+
+struct tc_entry {
+	struct nl_object *	te_obj;
+	int			te_ifindex;
+	uint32_t		te_parent;
+	struct list_head	te_list;
+};
+
+static struct tc_index qdisc_index, class_index, cls_index;
+
+static struct nl_sock *sock, *stats_sock;
+static struct nl_cache *link_cache, *qdisc_cache;
+static struct nl_cache_mngr *mngr;
+
+enum {
+	INFO_MTU,
+	INFO_MPU,
+	INFO_OVERHEAD,
+	INFO_ID,
+	INFO_PARENT,
+	INFO_WEIGHT,
+	INFO_FLAGS,
+	INFO_OPERSTATE,
+	INFO_IFINDEX,
+	INFO_ADDRESS,
+	INFO_BROADCAST,
+	INFO_MODE,
+	INFO_TXQLEN,
+	INFO_FAMILY,
+	INFO_ALIAS,
+	INFO_QDISC,
+	__INFO_MAX,
+};
+
+static const char *info_names[__INFO_MAX] = {
+	[INFO_MTU]		= "MTU",
+	[INFO_MPU]		= "MPU",
+	[INFO_OVERHEAD]		= "Overhead",
+	[INFO_ID]		= "Id",
+	[INFO_PARENT]		= "Parent",
+	[INFO_WEIGHT]		= "Weight",
+	[INFO_FLAGS]		= "Flags",
+	[INFO_OPERSTATE]	= "Operstate",
+	[INFO_IFINDEX]		= "IfIndex",
+	[INFO_ADDRESS]		= "Address",
+	[INFO_BROADCAST]	= "Broadcast",
+	[INFO_MODE]		= "Mode",
+	[INFO_TXQLEN]		= "TXQlen",
+	[INFO_FAMILY]		= "Family",
+	[INFO_ALIAS]		= "Alias",
+	[INFO_QDISC]		= "Qdisc",
+};
+
+/* interned keys of info_names[] */
+static int info_keys[__INFO_MAX];
+
+/* batch entries are in the order of link_attrs[] and tc_attrs[] */
+static struct attr_batch link_batch, tc_batch;
+static uint64_t ip6_mask;
 
 static void update_tc_attrs(struct element *e, struct rtnl_tc *tc)
 {
+	uint64_t tx[ARRAY_SIZE(tc_attrs)];
+	uint64_t mask = attr_batch_demand(&tc_batch);
 	int i;
 
-	for (i = 0; i < ARRAY_SIZE(tc_attrs); i++) {
-		uint64_t c_tx = rtnl_tc_get_stat(tc, tc_attrs[i].txid);
-		attr_update(e, tc_attrs[i].attrid, 0, c_tx, UPDATE_FLAG_TX);
+	for (i = 0; i < ARRAY_SIZE(tc_attrs); i++)
+		if (mask & (1ULL << i))
+			tx[i] = rtnl_tc_get_stat(tc, tc_attrs[i].txid);
+
+	attr_update_batch(e, &tc_batch, NULL, tx, mask);
+}
+
+/* formats the value only if it has changed */
+static void set_info_num(struct element *e, int info, const char *fmt,
+			 uint32_t num)
+{
+	char buf[32];
+
+	if (element_info_stale(e, info_keys[info], num)) {
+		snprintf(buf, sizeof(buf), fmt, num);
+		element_set_info(e, info_keys[info], buf);
+	}
+}
+
+static uint64_t addr_hash(struct nl_addr *addr)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	unsigned char *p;
+	unsigned int i, len;
+
+	if (!addr)
+		return 0;
+
+	p = nl_addr_get_binary_addr(addr);
+	len = nl_addr_get_len(addr);
+
+	for (i = 0; i < len; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+
+	return hash ^ len;
+}
+
+static void set_info_addr(struct element *e, int info, struct nl_addr *addr)
+{
+	char buf[64];
+
+	if (element_info_stale(e, info_keys[info], addr_hash(addr))) {
+		nl_addr2str(addr, buf, sizeof(buf));
+		element_set_info(e, info_keys[info], buf);
 	}
 }
 
 static void update_tc_infos(struct element *e, struct rtnl_tc *tc)
 {
-	char buf[32];
+	set_info_num(e, INFO_MTU, "%u", rtnl_tc_get_mtu(tc));
+	set_info_num(e, INFO_MPU, "%u", rtnl_tc_get_mpu(tc));
+	set_info_num(e, INFO_OVERHEAD, "%u", rtnl_tc_get_overhead(tc));
+	set_info_num(e, INFO_ID, "%#x", rtnl_tc_get_handle(tc));
+	set_info_num(e, INFO_PARENT, "%#x", rtnl_tc_get_parent(tc));
+}
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_tc_get_mtu(tc));
-	element_update_info(e, "MTU", buf);
+/*
+ * Issues a dump request and passes every reply to handler. The link
+ * statistics are dumped on a separate socket as handle_tc() issues
+ * requests of its own while that dump is still being received.
+ */
+static int dump_request(struct nl_sock *sk, int type, void *hdr,
+			size_t hdrlen, nl_recvmsg_msg_cb_t handler, void *arg)
+{
+	struct nl_cb *cb;
+	int err;
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_tc_get_mpu(tc));
-	element_update_info(e, "MPU", buf);
+	if ((err = nl_send_simple(sk, type, NLM_F_DUMP, hdr, hdrlen)) < 0)
+		return err;
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_tc_get_overhead(tc));
-	element_update_info(e, "Overhead", buf);
+	if (!(cb = nl_cb_clone(nl_socket_get_cb(sk))))
+		return -NLE_NOMEM;
 
-	snprintf(buf, sizeof(buf), "%#x", rtnl_tc_get_handle(tc));
-	element_update_info(e, "Id", buf);
+	nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, handler, arg);
+	err = nl_recvmsgs(sk, cb);
+	nl_cb_put(cb);
 
-	snprintf(buf, sizeof(buf), "%#x", rtnl_tc_get_parent(tc));
-	element_update_info(e, "Parent", buf);
+	return err;
+}
+
+static void tc_index_init(struct tc_index *idx)
+{
+	int i;
+
+	for (i = 0; i < TC_INDEX_SIZE; i++)
+		init_list_head(&idx->ti_hash[i]);
+}
 
+static inline unsigned int tc_hash(int ifindex, uint32_t parent)
+{
+	return (ifindex ^ parent ^ (parent >> 16)) % TC_INDEX_SIZE;
+}
+
+static void tc_index_add(struct tc_index *idx, int ifindex, uint32_t parent,
+			 struct nl_object *obj)
+{
+	struct tc_entry *te = xcalloc(1, sizeof(*te));
+
+	nl_object_get(obj);
+
+	te->te_obj = obj;
+	te->te_ifindex = ifindex;
+	te->te_parent = parent;
+
+	list_add_tail(&te->te_list, &idx->ti_hash[tc_hash(ifindex, parent)]);
+}
+
+static void tc_index_foreach(struct tc_index *idx, int ifindex, uint32_t parent,
+			     void (*cb)(struct nl_object *, void *), void *arg)
+{
+	struct tc_entry *te;
+
+	list_for_each_entry(te, &idx->ti_hash[tc_hash(ifindex, parent)], te_list)
+		if (te->te_ifindex == ifindex && te->te_parent == parent)
+			cb(te->te_obj, arg);
+}
+
+static void tc_index_flush(struct tc_index *idx)
+{
+	struct tc_entry *te, *n;
+	int i;
+
+	for (i = 0; i < TC_INDEX_SIZE; i++) {
+		list_for_each_entry_safe(te, n, &idx->ti_hash[i], te_list) {
+			nl_object_put(te->te_obj);
+			list_del(&te->te_list);
+			xfree(te);
+		}
+	}
 }
 
 static void handle_qdisc(struct nl_object *obj, void *);
@@ -244,6 +422,7 @@ static void handle_class(struct nl_object *obj, void *arg)
 	struct rdata *rdata = arg;
 	struct rdata ndata = {
 		.level = rdata->level + 1,
+		.ifindex = rdata->ifindex,
 	};
 
 	if (!(e = handle_tc_obj(tc, "class", rdata)))
@@ -260,44 +439,20 @@ static void handle_class(struct nl_object *obj, void *arg)
 
 static void find_qdiscs(uint32_t parent, struct rdata *rdata)
 {
-	struct rtnl_qdisc *filter;
-
-	if (!(filter = rtnl_qdisc_alloc()))
-		return;
-
-	rtnl_tc_set_parent((struct rtnl_tc *) filter, parent);
-
-	nl_cache_foreach_filter(qdisc_cache, OBJ_CAST(filter),
-				handle_qdisc, rdata);
-
-	rtnl_qdisc_put(filter);
+	tc_index_foreach(&qdisc_index, rdata->ifindex, parent,
+			 handle_qdisc, rdata);
 }
 
-static void find_cls(int ifindex, uint32_t parent, struct rdata *rdata)
+static void find_cls(uint32_t parent, struct rdata *rdata)
 {
-	struct nl_cache *cls_cache;
-
-	if (rtnl_cls_alloc_cache(sock, ifindex, parent, &cls_cache) < 0)
-		return;
-
-	nl_cache_foreach(cls_cache, handle_cls, rdata);
-
-	nl_cache_free(cls_cache);
+	tc_index_foreach(&cls_index, rdata->ifindex, parent,
+			 handle_cls, rdata);
 }
 
 static void find_classes(uint32_t parent, struct rdata *rdata)
 {
-	struct rtnl_class *filter;
-
-	if (!(filter = rtnl_class_alloc()))
-		return;
-
-	rtnl_tc_set_parent((struct rtnl_tc *) filter, parent);
-
-	nl_cache_foreach_filter(class_cache, OBJ_CAST(filter),
-				handle_class, rdata);
-
-	rtnl_class_put(filter);
+	tc_index_foreach(&class_index, rdata->ifindex, parent,
+			 handle_class, rdata);
 }
 
 static void handle_qdisc(struct nl_object *obj, void *arg)
@@ -307,6 +462,7 @@ static void handle_qdisc(struct nl_object *obj, void *arg)
 	struct rdata *rdata = arg;
 	struct rdata ndata = {
 		.level = rdata->level + 1,
+		.ifindex = rdata->ifindex,
 	};
 
 	if (!(e = handle_tc_obj(tc, "qdisc", rdata)))
@@ -314,143 +470,485 @@ static void handle_qdisc(struct nl_object *obj, void *arg)
 
 	ndata.parent = e;
 
-	find_cls(rtnl_tc_get_ifindex(tc), rtnl_tc_get_handle(tc), &ndata);
+	find_cls(rtnl_tc_get_handle(tc), &ndata);
 
 	if (rtnl_tc_get_parent(tc) == TC_H_ROOT) {
-		find_cls(rtnl_tc_get_ifindex(tc), TC_H_ROOT, &ndata);
+		find_cls(TC_H_ROOT, &ndata);
 		find_classes(TC_H_ROOT, &ndata);
 	}
 
 	find_classes(rtnl_tc_get_handle(tc), &ndata);
 }
 
+static void index_class(struct nl_object *obj, void *arg)
+{
+	struct rtnl_tc *tc = (struct rtnl_tc *) obj;
+
+	tc_index_add(&class_index, rtnl_tc_get_ifindex(tc),
+		     rtnl_tc_get_parent(tc), obj);
+}
+
+static int handle_class_msg(struct nl_msg *msg, void *arg)
+{
+	nl_msg_parse(msg, index_class, arg);
+
+	return NL_OK;
+}
+
+/*
+ * Classifiers are indexed by the parent they were dumped for, the
+ * parent reported by the kernel may differ, e.g. for ingress filters.
+ */
+static void index_cls(struct nl_object *obj, void *arg)
+{
+	struct tcmsg *key = arg;
+
+	tc_index_add(&cls_index, key->tcm_ifindex, key->tcm_parent, obj);
+}
+
+static int handle_cls_msg(struct nl_msg *msg, void *arg)
+{
+	nl_msg_parse(msg, index_cls, arg);
+
+	return NL_OK;
+}
+
+static void dump_cls(int ifindex, uint32_t parent)
+{
+	struct tcmsg tchdr = {
+		.tcm_family = AF_UNSPEC,
+		.tcm_ifindex = ifindex,
+		.tcm_parent = parent,
+	};
+
+	dump_request(sock, RTM_GETTFILTER, &tchdr, sizeof(tchdr),
+		     handle_cls_msg, &tchdr);
+}
+
+static void index_qdisc(struct nl_object *obj, void *arg)
+{
+	struct rtnl_tc *tc = (struct rtnl_tc *) obj;
+	int *nqdiscs = arg;
+
+	tc_index_add(&qdisc_index, rtnl_tc_get_ifindex(tc),
+		     rtnl_tc_get_parent(tc), obj);
+
+	(*nqdiscs)++;
+}
+
+/*
+ * Builds the indexes for all traffic control objects of a link: the
+ * qdiscs from the qdisc cache, the classes from a single class dump
+ * and the classifiers attached to each qdisc and class.
+ */
+static int build_tc_index(int ifindex)
+{
+	struct rtnl_qdisc *filter;
+	struct tcmsg tchdr = {
+		.tcm_family = AF_UNSPEC,
+		.tcm_ifindex = ifindex,
+	};
+	struct tc_entry *te;
+	int i, nqdiscs = 0;
+
+	if (!(filter = rtnl_qdisc_alloc()))
+		return 0;
+
+	rtnl_tc_set_ifindex((struct rtnl_tc *) filter, ifindex);
+	nl_cache_foreach_filter(qdisc_cache, OBJ_CAST(filter),
+				index_qdisc, &nqdiscs);
+	rtnl_qdisc_put(filter);
+
+	/* links without any qdisc can't have classes or classifiers */
+	if (!nqdiscs)
+		return 0;
+
+	if (dump_request(sock, RTM_GETTCLASS, &tchdr, sizeof(tchdr),
+			 handle_class_msg, NULL) < 0)
+		return 0;
+
+	for (i = 0; i < TC_INDEX_SIZE; i++) {
+		list_for_each_entry(te, &qdisc_index.ti_hash[i], te_list) {
+			struct rtnl_tc *tc = (struct rtnl_tc *) te->te_obj;
+
+			dump_cls(ifindex, rtnl_tc_get_handle(tc));
+
+			if (rtnl_tc_get_parent(tc) == TC_H_ROOT)
+				dump_cls(ifindex, TC_H_ROOT);
+		}
+
+		list_for_each_entry(te, &class_index.ti_hash[i], te_list)
+			dump_cls(ifindex,
+				 rtnl_tc_get_handle((struct rtnl_tc *) te->te_obj));
+	}
+
+	return 1;
+}
+
 static void handle_tc(struct element *e, struct rtnl_link *link)
 {
-	struct rtnl_qdisc *qdisc;
 	int ifindex = rtnl_link_get_ifindex(link);
 	struct rdata rdata = {
 		.level = 1,
 		.parent = e,
+		.ifindex = ifindex,
 	};
 
-	if (rtnl_class_alloc_cache(sock, ifindex, &class_cache) < 0)
-		return;
-
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, TC_H_ROOT);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
+	if (build_tc_index(ifindex)) {
+		find_qdiscs(TC_H_ROOT, &rdata);
+		find_qdiscs(0, &rdata);
+		find_qdiscs(TC_H_INGRESS, &rdata);
 	}
 
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, 0);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
+	tc_index_flush(&qdisc_index);
+	tc_index_flush(&class_index);
+	tc_index_flush(&cls_index);
+}
+
+/*
+ * Cheap enough to be called for every link message, values are only
+ * formatted if the underlying number has changed.
+ */
+static void update_link_infos(struct element *e, struct rtnl_link *link)
+{
+	unsigned int flags = rtnl_link_get_flags(link);
+	uint8_t operstate = rtnl_link_get_operstate(link);
+	uint8_t mode = rtnl_link_get_linkmode(link);
+	int family = rtnl_link_get_family(link);
+	char buf[128];
+
+	set_info_num(e, INFO_MTU, "%u", rtnl_link_get_mtu(link));
+	set_info_num(e, INFO_WEIGHT, "%#x", rtnl_link_get_weight(link));
+
+	if (element_info_stale(e, info_keys[INFO_FLAGS], flags)) {
+		rtnl_link_flags2str(flags, buf, sizeof(buf));
+		element_set_info(e, info_keys[INFO_FLAGS], buf);
 	}
 
-	qdisc = rtnl_qdisc_get_by_parent(qdisc_cache, ifindex, TC_H_INGRESS);
-	if (qdisc) {
-		handle_qdisc(OBJ_CAST(qdisc), &rdata);
-		rtnl_qdisc_put(qdisc);
+	if (element_info_stale(e, info_keys[INFO_OPERSTATE], operstate)) {
+		rtnl_link_operstate2str(operstate, buf, sizeof(buf));
+		element_set_info(e, info_keys[INFO_OPERSTATE], buf);
 	}
 
-	nl_cache_free(class_cache);
-}
+	set_info_num(e, INFO_IFINDEX, "%u", rtnl_link_get_ifindex(link));
+	set_info_addr(e, INFO_ADDRESS, rtnl_link_get_addr(link));
+	set_info_addr(e, INFO_BROADCAST, rtnl_link_get_broadcast(link));
 
-static void update_link_infos(struct element *e, struct rtnl_link *link)
-{
-	char buf[32];
+	if (element_info_stale(e, info_keys[INFO_MODE], mode)) {
+		rtnl_link_mode2str(mode, buf, sizeof(buf));
+		element_set_info(e, info_keys[INFO_MODE], buf);
+	}
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_link_get_mtu(link));
-	element_update_info(e, "MTU", buf);
+	set_info_num(e, INFO_TXQLEN, "%u", rtnl_link_get_txqlen(link));
 
-	snprintf(buf, sizeof(buf), "%#x", rtnl_link_get_weight(link));
-	element_update_info(e, "Weight", buf);
+	if (element_info_stale(e, info_keys[INFO_FAMILY], family)) {
+		nl_af2str(family, buf, sizeof(buf));
+		element_set_info(e, info_keys[INFO_FAMILY], buf);
+	}
 
-	rtnl_link_flags2str(rtnl_link_get_flags(link), buf, sizeof(buf));
-	element_update_info(e, "Flags", buf);
+	element_set_info(e, info_keys[INFO_ALIAS],
+			 rtnl_link_get_ifalias(link) ? : "");
+	element_set_info(e, info_keys[INFO_QDISC],
+			 rtnl_link_get_qdisc(link) ? : "");
+}
 
-	rtnl_link_operstate2str(rtnl_link_get_operstate(link),
-				buf, sizeof(buf));
-	element_update_info(e, "Operstate", buf);
+/*
+ * Links are looked up by interface index, the name is only compared to
+ * catch renames and reused interface indices.
+ */
+static struct element *link_element(struct rtnl_link *link)
+{
+	int ifindex = rtnl_link_get_ifindex(link);
+	const char *name = rtnl_link_get_name(link);
+	struct element *e;
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_link_get_ifindex(link));
-	element_update_info(e, "IfIndex", buf);
+	if ((e = element_find_index(grp, ifindex, NULL)) &&
+	    strcmp(e->e_name, name)) {
+		element_set_index(e, 0);
+		e = NULL;
+	}
 
-	nl_addr2str(rtnl_link_get_addr(link), buf, sizeof(buf));
-	element_update_info(e, "Address", buf);
+	if (!e) {
+		if (!(e = element_lookup(grp, name, 0, NULL)))
+			return NULL;
 
-	nl_addr2str(rtnl_link_get_broadcast(link), buf, sizeof(buf));
-	element_update_info(e, "Broadcast", buf);
+		element_set_index(e, ifindex);
+	}
 
-	rtnl_link_mode2str(rtnl_link_get_linkmode(link),
-			   buf, sizeof(buf));
-	element_update_info(e, "Mode", buf);
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
 
-	snprintf(buf, sizeof(buf), "%u", rtnl_link_get_txqlen(link));
-	element_update_info(e, "TXQlen", buf);
+		element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
+		element_set_usage_attr(e, ATTR_BYTES);
 
-	nl_af2str(rtnl_link_get_family(link), buf, sizeof(buf));
-	element_update_info(e, "Family", buf);
+		update_link_infos(e, link);
 
-	element_update_info(e, "Alias",
-		rtnl_link_get_ifalias(link) ? : "");
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
 
-	element_update_info(e, "Qdisc",
-		rtnl_link_get_qdisc(link) ? : "");
+	return e;
 }
 
+#define IS_IP6_STAT(id) \
+	((id) >= RTNL_LINK_IP6_INPKTS && (id) <= RTNL_LINK_IP6_CEPKTS)
+
 static void do_link(struct nl_object *obj, void *arg)
 {
 	struct rtnl_link *link = (struct rtnl_link *) obj;
+	uint64_t rx[ARRAY_SIZE(link_attrs)], tx[ARRAY_SIZE(link_attrs)];
+	uint64_t mask = attr_batch_demand(&link_batch);
 	struct element *e;
 	int i;
 
 	if (!cfg_show_all && !(rtnl_link_get_flags(link) & IFF_UP))
 		return;
 
-	if (!(e = element_lookup(grp, rtnl_link_get_name(link), 0, NULL)))
+	if (!(e = link_element(link)))
 		return;
 
-	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+	if (c_events && use_getstats && !c_ipv6)
+		mask &= ~ip6_mask;
 
-		element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
-		element_set_usage_attr(e, ATTR_BYTES);
+	for (i = 0; i < ARRAY_SIZE(link_attrs); i++) {
+		struct attr_map *m = &link_attrs[i];
 
-		update_link_infos(e, link);
+		if (!(mask & (1ULL << i)))
+			continue;
 
-		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+		rx[i] = m->rxid >= 0 ? rtnl_link_get_stat(link, m->rxid) : 0;
+		tx[i] = m->txid >= 0 ? rtnl_link_get_stat(link, m->txid) : 0;
 	}
 
-	for (i = 0; i < ARRAY_SIZE(link_attrs); i++) {
-		struct attr_map *m = &link_attrs[i];
-		uint64_t c_rx = 0, c_tx = 0;
-		int flags = 0;
+	attr_update_batch(e, &link_batch, rx, tx, mask);
 
-		if (m->rxid >= 0) {
-			c_rx = rtnl_link_get_stat(link, m->rxid);
-			flags |= UPDATE_FLAG_RX;
+	/* with events enabled, link_change() keeps the infos current */
+	if (!c_events)
+		update_link_infos(e, link);
+
+	if (!c_notc)
+		handle_tc(e, link);
+
+	element_notify_update(e, NULL);
+	element_lifesign(e, 1);
+}
+
+/*
+ * Called by the cache manager for every link notification. Elements
+ * are created as soon as a link shows up and are released right away
+ * when the link is deleted instead of waiting for them to expire.
+ */
+static void link_change(struct nl_cache *cache, struct nl_object *obj,
+			int action, void *arg)
+{
+	struct rtnl_link *link = (struct rtnl_link *) obj;
+	struct element *e;
+
+	switch (action) {
+	case NL_ACT_NEW:
+	case NL_ACT_CHANGE:
+		if (!cfg_show_all && !(rtnl_link_get_flags(link) & IFF_UP))
+			return;
+
+		if ((e = link_element(link)) && action == NL_ACT_CHANGE)
+			update_link_infos(e, link);
+		break;
+
+	case NL_ACT_DEL:
+		if ((e = element_find_index(grp, rtnl_link_get_ifindex(link),
+					    NULL))) {
+			DBG(2, "Link %s deleted\n", e->e_name);
+			element_free(e);
 		}
+		break;
+	}
+}
 
-		if (m->txid >= 0) {
-			c_tx = rtnl_link_get_stat(link, m->txid);
-			flags |= UPDATE_FLAG_TX;
+static int handle_link_msg(struct nl_msg *msg, void *arg)
+{
+	nl_msg_parse(msg, do_link, arg);
+
+	return NL_OK;
+}
+
+static void set_link_stats64(struct rtnl_link *link,
+			     const struct rtnl_link_stats64 *st)
+{
+	rtnl_link_set_stat(link, RTNL_LINK_RX_PACKETS, st->rx_packets);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_PACKETS, st->tx_packets);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_BYTES, st->rx_bytes);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_BYTES, st->tx_bytes);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_ERRORS, st->rx_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_ERRORS, st->tx_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_DROPPED, st->rx_dropped);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_DROPPED, st->tx_dropped);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_COMPRESSED, st->rx_compressed);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_COMPRESSED, st->tx_compressed);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_FIFO_ERR, st->rx_fifo_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_FIFO_ERR, st->tx_fifo_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_LEN_ERR, st->rx_length_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_OVER_ERR, st->rx_over_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_CRC_ERR, st->rx_crc_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_FRAME_ERR, st->rx_frame_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_RX_MISSED_ERR, st->rx_missed_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_ABORT_ERR, st->tx_aborted_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_CARRIER_ERR, st->tx_carrier_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_HBEAT_ERR, st->tx_heartbeat_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_TX_WIN_ERR, st->tx_window_errors);
+	rtnl_link_set_stat(link, RTNL_LINK_COLLISIONS, st->collisions);
+	rtnl_link_set_stat(link, RTNL_LINK_MULTICAST, st->multicast);
+}
+
+/*
+ * RTM_NEWSTATS only carries the interface index, the link itself is
+ * looked up in the link cache maintained by the cache manager.
+ */
+static int handle_stats_msg(struct nl_msg *msg, void *arg)
+{
+	struct nlmsghdr *nlh = nlmsg_hdr(msg);
+	struct nlattr *tb[IFLA_STATS_MAX+1];
+	struct rtnl_link_stats64 st;
+	struct if_stats_msg *ifsm;
+	struct rtnl_link *link;
+
+	if (nlh->nlmsg_type != RTM_NEWSTATS ||
+	    nlmsg_parse(nlh, sizeof(*ifsm), tb, IFLA_STATS_MAX, NULL) < 0 ||
+	    !tb[IFLA_STATS_LINK_64])
+		return NL_SKIP;
+
+	ifsm = nlmsg_data(nlh);
+
+	/* links not announced yet are picked up on the next read */
+	if (!(link = rtnl_link_get(link_cache, ifsm->ifindex)))
+		return NL_SKIP;
+
+	memset(&st, 0, sizeof(st));
+	nla_memcpy(&st, tb[IFLA_STATS_LINK_64], sizeof(st));
+
+	set_link_stats64(link, &st);
+	do_link(OBJ_CAST(link), arg);
+
+	rtnl_link_put(link);
+
+	return NL_OK;
+}
+
+static void copy_ip6_stats(struct nl_object *obj, void *arg)
+{
+	struct rtnl_link *l6 = (struct rtnl_link *) obj, *link;
+	int i;
+
+	if (!(link = rtnl_link_get(link_cache, rtnl_link_get_ifindex(l6))))
+		return;
+
+	for (i = RTNL_LINK_IP6_INPKTS; i <= RTNL_LINK_IP6_CEPKTS; i++)
+		rtnl_link_set_stat(link, i, rtnl_link_get_stat(l6, i));
+
+	rtnl_link_put(link);
+}
+
+static int handle_ip6_msg(struct nl_msg *msg, void *arg)
+{
+	nl_msg_parse(msg, copy_ip6_stats, arg);
+
+	return NL_OK;
+}
+
+/*
+ * Fetches the counters of all links. RTM_GETSTATS is asked for the
+ * 64bit link statistics only, the IPv6 statistics are fetched with an
+ * additional AF_INET6 link dump if requested. Kernels without
+ * RTM_GETSTATS get a full link dump which is parsed on the fly instead
+ * of being merged into the link cache.
+ */
+static void read_link_stats(void)
+{
+	struct if_stats_msg ifsm = {
+		.family = AF_UNSPEC,
+		.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64),
+	};
+	struct rtgenmsg gmsg = {
+		.rtgen_family = AF_UNSPEC,
+	};
+	int err;
+
+	if (use_getstats) {
+		if (c_ipv6 && (attr_batch_demand(&link_batch) & ip6_mask)) {
+			gmsg.rtgen_family = AF_INET6;
+			if ((err = dump_request(stats_sock, RTM_GETLINK, &gmsg,
+						sizeof(gmsg), handle_ip6_msg,
+						NULL)) < 0)
+				quit("Unable to read IPv6 statistics: %s\n",
+					nl_geterror(err));
 		}
 
-		attr_update(e, m->attrid, c_rx, c_tx, flags);
+		err = dump_request(stats_sock, RTM_GETSTATS, &ifsm, sizeof(ifsm),
+				   handle_stats_msg, NULL);
+		if (err != -NLE_OPNOTSUPP && err != -NLE_INVAL)
+			goto out;
+
+		DBG(1, "RTM_GETSTATS not supported, using link dumps\n");
+		use_getstats = 0;
+		gmsg.rtgen_family = AF_UNSPEC;
+	}
+
+	err = dump_request(stats_sock, RTM_GETLINK, &gmsg, sizeof(gmsg),
+			   handle_link_msg, NULL);
+out:
+	if (err < 0)
+		quit("Unable to read link statistics: %s\n",
+			nl_geterror(err));
+}
+
+static void update_qdisc_cache(void)
+{
+	int err;
+
+	if (qdisc_cache == NULL) {
+		err = rtnl_qdisc_alloc_cache(sock, &qdisc_cache);
+		if (err < 0)
+			quit("Unable to allocate qdisc cache: %s\n",
+				nl_geterror(err));
+	} else {
+		err = nl_cache_resync(sock, qdisc_cache, NULL, NULL);
+		if (err < 0)
+			quit("Unable to resync qdisc cache: %s\n",
+				nl_geterror(err));
+	}
+}
+
+static void netlink_read_events(void)
+{
+	int err;
+
+	/*
+	 * Apply all pending link notifications. If the socket buffer
+	 * overflowed, notifications have been lost and the link cache
+	 * is resynced, reporting the differences through link_change().
+	 */
+	if ((err = nl_cache_mngr_data_ready(mngr)) < 0) {
+		DBG(1, "Lost link notifications (%s), resyncing\n",
+		    nl_geterror(err));
+
+		err = nl_cache_resync(sock, link_cache, link_change, NULL);
+		if (err < 0)
+			quit("Unable to resync link cache: %s\n",
+				nl_geterror(err));
 	}
 
 	if (!c_notc)
-		handle_tc(e, link);
+		update_qdisc_cache();
 
-	element_notify_update(e, NULL);
-	element_lifesign(e, 1);
+	read_link_stats();
 }
 
 static void netlink_read(void)
 {
 	int err;
 
+	if (c_events) {
+		netlink_read_events();
+		return;
+	}
+
 	if (link_cache == NULL) {
 		err = rtnl_link_alloc_cache(sock, AF_UNSPEC, &link_cache);
 		if (err < 0)
@@ -463,25 +961,19 @@ static void netlink_read(void)
 				nl_geterror(err));
 	}
 
-	if (qdisc_cache == NULL) {
-		err = rtnl_qdisc_alloc_cache(sock, &qdisc_cache);
-		if (err < 0)
-			quit("Unable to allocate qdisc cache: %s\n",
-				nl_geterror(err));
-	} else {
-		err = nl_cache_resync(sock, qdisc_cache, NULL, NULL);
-		if (err < 0)
-			quit("Unable to resync qdisc cache: %s\n",
-				nl_geterror(err));
-	}
+	update_qdisc_cache();
 
 	nl_cache_foreach(link_cache, do_link, NULL);
 }
 
 static void netlink_shutdown(void)
 {
-	nl_cache_free(link_cache);
+	if (mngr)
+		nl_cache_mngr_free(mngr);
+	else
+		nl_cache_free(link_cache);
 	nl_cache_free(qdisc_cache);
+	nl_socket_free(stats_sock);
 	nl_socket_free(sock);
 }
 
@@ -506,6 +998,21 @@ static void netlink_do_init(void)
 					 m->type, 0);
 	}
 
+	for (i = 0; i < ARRAY_SIZE(link_attrs); i++) {
+		struct attr_map *m = &link_attrs[i];
+		int flags = 0;
+
+		if (m->rxid >= 0)
+			flags |= UPDATE_FLAG_RX;
+		if (m->txid >= 0)
+			flags |= UPDATE_FLAG_TX;
+
+		attr_batch_add(&link_batch, m->attrid, flags);
+
+		if (IS_IP6_STAT(m->rxid) || IS_IP6_STAT(m->txid))
+			ip6_mask |= 1ULL << i;
+	}
+
 	for (i = 0; i < ARRAY_SIZE(tc_attrs); i++) {
 		struct attr_map *m = &tc_attrs[i];
 		struct unit *u;
@@ -517,8 +1024,37 @@ static void netlink_do_init(void)
 					 m->type, 0);
 	}
 
+	for (i = 0; i < ARRAY_SIZE(tc_attrs); i++)
+		attr_batch_add(&tc_batch, tc_attrs[i].attrid, UPDATE_FLAG_TX);
+
+	for (i = 0; i < __INFO_MAX; i++)
+		info_keys[i] = element_info_key(info_names[i]);
+
 	if (!(grp = group_lookup(c_group, GROUP_CREATE)))
 		BUG();
+
+	tc_index_init(&qdisc_index);
+	tc_index_init(&class_index);
+	tc_index_init(&cls_index);
+
+	if (c_events) {
+		if (!(stats_sock = nl_socket_alloc()))
+			quit("Unable to allocate netlink socket\n");
+
+		if ((err = nl_connect(stats_sock, NETLINK_ROUTE)) < 0)
+			quit("Unable to connect netlink socket: %s\n",
+				nl_geterror(err));
+
+		if ((err = nl_cache_mngr_alloc(NULL, NETLINK_ROUTE,
+					       NL_AUTO_PROVIDE, &mngr)) < 0)
+			quit("Unable to allocate cache manager: %s\n",
+				nl_geterror(err));
+
+		if ((err = nl_cache_mngr_add(mngr, "route/link", link_change,
+					     NULL, &link_cache)) < 0)
+			quit("Unable to subscribe to link events: %s\n",
+				nl_geterror(err));
+	}
 }
 
 static int netlink_probe(void)
@@ -551,6 +1087,8 @@ static void print_help(void)
 	"\n" \
 	"  Options:\n" \
 	"    notc           Do not collect traffic control statistics\n" \
+	"    events         Track links via notifications instead of resyncing\n" \
+	"    ipv6           Collect IPv6 statistics in events mode\n" \
 	"    group=NAME     Alternative group name (default: Interfaces)\n");
 }
 
@@ -558,6 +1096,10 @@ static void netlink_parse_opt(const char *type, const char *value)
 {
 	if (!strcasecmp(type, "notc"))
 		c_notc = 1;
+	else if (!strcasecmp(type, "events"))
+		c_events = 1;
+	else if (!strcasecmp(type, "ipv6"))
+		c_ipv6 = 1;
 	else if (!strcasecmp(type, "group") && value)
 		c_group = value;
 	else if (!strcasecmp(type, "help")) {
@@ -33,90 +33,175 @@ static const char *c_path = "/proc/net/dev";
 static const char *c_group = DEFAULT_GROUP;
 static struct element_group *grp;
 
-static void proc_read(void)
+static int proc_fd = -1;
+static char *proc_buf;
+static size_t proc_bufsize = 4096;
+
+struct attr_map {
+	const char *	name;
+	const char *	description;
+	const char *	unit;
+};
+
+static struct attr_map proc_attrs[] = {
+	{ "bytes",	"Bytes",	"byte" },
+	{ "packets",	"Packets",	"number" },
+	{ "errors",	"Errors",	"number" },
+	{ "drop",	"Dropped",	"number" },
+	{ "fifo",	"FIFO Error",	"number" },
+	{ "frame",	"Frame Error",	"number" },
+	{ "compressed",	"Compressed",	"number" },
+	{ "multicast",	"Multicast",	"number" },
+};
+
+/* order of the attributes in each half of a /proc/net/dev line */
+static const int proc_cols[] = {
+	ATTR_BYTES, ATTR_PACKETS, ATTR_ERRORS, ATTR_DROP,
+	ATTR_FIFO, ATTR_FRAME, ATTR_COMPRESSED, ATTR_MULTICAST,
+};
+
+#define NCOLS	ARRAY_SIZE(proc_cols)
+
+static struct attr_batch proc_batch;
+
+/*
+ * Reads the whole file into proc_buf. procfs regenerates the content
+ * on every read at offset 0, so the descriptor is kept open across
+ * reads. procfs files are seq_files which return about a page per
+ * read, therefore reading continues until end of file.
+ */
+static size_t proc_read_file(void)
+{
+	size_t len = 0;
+	ssize_t n;
+
+	if (!proc_buf)
+		proc_buf = xcalloc(1, proc_bufsize);
+
+	for (;;) {
+		if (len == proc_bufsize - 1) {
+			proc_bufsize *= 2;
+			proc_buf = xrealloc(proc_buf, proc_bufsize);
+		}
+
+		n = pread(proc_fd, proc_buf + len, proc_bufsize - len - 1,
+			  len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			quit("Unable to read file %s: %s\n",
+			     c_path, strerror(errno));
+		}
+
+		if (n == 0)
+			break;
+
+		len += n;
+	}
+
+	proc_buf[len] = '\0';
+
+	return len;
+}
+
+/*
+ * Parses an unsigned decimal integer preceded by blanks. Returns a
+ * pointer to the first character after the number or NULL if no
+ * number was found.
+ */
+static inline char *scan_u64(char *p, uint64_t *val)
+{
+	uint64_t v = 0;
+	char *s;
+
+	while (*p == ' ')
+		p++;
+
+	for (s = p; *p >= '0' && *p <= '9'; p++)
+		v = v * 10 + (*p - '0');
+
+	if (p == s)
+		return NULL;
+
+	*val = v;
+
+	return p;
+}
+
+/*
+ * Every element is tagged with the line number it was last seen at. As
+ * long as the interface list does not change, the element is found
+ * through the index hash and a single name comparison.
+ */
+static struct element *line_element(char *name, size_t len, uint32_t line)
 {
 	struct element *e;
-	FILE *fd;
-	char buf[512], *p, *s;
-	int w;
-	
-	if (!(fd = fopen(c_path, "r")))
-		quit("Unable to open file %s: %s\n", c_path, strerror(errno));
 
-	/* Ignore header */
-	fgets(buf, sizeof(buf), fd);
-	fgets(buf, sizeof(buf), fd);
-	
-	for (; fgets(buf, sizeof(buf), fd);) {
-		uint64_t rx_errors, rx_drop, rx_fifo, rx_frame, rx_compressed;
-		uint64_t rx_multicast, tx_errors, tx_drop, tx_fifo, tx_frame;
-		uint64_t tx_compressed, tx_multicast, rx_bytes, tx_bytes;
-		uint64_t rx_packets, tx_packets;
-		
-		if (buf[0] == '\r' || buf[0] == '\n')
-			continue;
+	if ((e = element_find_index(grp, line, NULL))) {
+		if (!strncmp(e->e_name, name, len) && e->e_name[len] == '\0')
+			return e;
 
-		if (!(p = strchr(buf, ':')))
-			continue;
-		*p = '\0';
-		s = (p + 1);
-		
-		for (p = &buf[0]; *p == ' '; p++);
-
-		w = sscanf(s, "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " "
-			      "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " "
-			      "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " "
-			      "%" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
-			      "\n",
-			      &rx_bytes, &rx_packets, &rx_errors, &rx_drop,
-			      &rx_fifo, &rx_frame, &rx_compressed,
-			      &rx_multicast, &tx_bytes, &tx_packets,
-			      &tx_errors, &tx_drop, &tx_fifo, &tx_frame,
-			      &tx_compressed, &tx_multicast);
-		
-		if (w != 16)
-			continue;
+		element_set_index(e, 0);
+	}
 
-		if (!(e = element_lookup(grp, p, 0, NULL)))
-			return;
+	name[len] = '\0';
 
-		if (e->e_flags & ELEMENT_FLAG_CREATED) {
+	if (!(e = element_lookup(grp, name, 0, NULL)))
+		return NULL;
 
-			element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
-			element_set_usage_attr(e, ATTR_BYTES);
+	element_set_index(e, line);
 
-			e->e_flags &= ~ELEMENT_FLAG_CREATED;
-		}
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+		element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
+		element_set_usage_attr(e, ATTR_BYTES);
+
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
+
+	return e;
+}
+
+static void proc_read(void)
+{
+	uint64_t rx[NCOLS], tx[NCOLS];
+	char *p, *name, *eol, *end;
+	struct element *e;
+	uint32_t line = 0;
+	size_t len;
+	int i;
+
+	len = proc_read_file();
+	end = proc_buf + len;
 
-		attr_update(e, ATTR_BYTES, rx_bytes, tx_bytes,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+	for (p = proc_buf; p < end; p = eol + 1) {
+		if (!(eol = strchr(p, '\n')))
+			eol = end;
 
-		attr_update(e, ATTR_PACKETS, rx_packets, tx_packets,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		/* Ignore header */
+		if (++line <= 2)
+			continue;
 
-		attr_update(e, ATTR_ERRORS, rx_errors, tx_errors,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		for (name = p; *name == ' '; name++);
 
-		attr_update(e, ATTR_DROP, rx_drop, tx_drop,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		if (!(p = memchr(name, ':', eol - name)))
+			continue;
 
-		attr_update(e, ATTR_FIFO, rx_fifo, tx_fifo,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		for (i = 0; i < NCOLS && p; i++)
+			p = scan_u64(p + (i == 0), &rx[i]);
 
-		attr_update(e, ATTR_FRAME, rx_frame, tx_frame,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		for (i = 0; i < NCOLS && p; i++)
+			p = scan_u64(p, &tx[i]);
 
-		attr_update(e, ATTR_COMPRESSED, rx_compressed, tx_compressed,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		if (!p)
+			continue;
 
-		attr_update(e, ATTR_MULTICAST, rx_multicast, tx_multicast,
-			    UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+		if (!(e = line_element(name, strchr(name, ':') - name, line)))
+			continue;
 
+		attr_update_batch(e, &proc_batch, rx, tx, ATTR_BATCH_ALL);
 		element_notify_update(e, NULL);
 		element_lifesign(e, 1);
 	}
-	
-	fclose(fd);
 }
 
 static void print_help(void)
@@ -146,10 +231,37 @@ static void proc_parse_opt(const char *type, const char *value)
 
 static void proc_do_init(void)
 {
+	int i;
+
+	if ((proc_fd = open(c_path, O_RDONLY | O_CLOEXEC)) < 0)
+		quit("Unable to open file %s: %s\n", c_path, strerror(errno));
+
+	for (i = 0; i < ARRAY_SIZE(proc_attrs); i++) {
+		struct attr_map *m = &proc_attrs[i];
+		struct unit *u;
+
+		if (!(u = unit_lookup(m->unit)))
+			continue;
+
+		attr_def_add(m->name, m->description, u, ATTR_TYPE_COUNTER, 0);
+	}
+
+	for (i = 0; i < NCOLS; i++)
+		attr_batch_add(&proc_batch, proc_cols[i],
+			       UPDATE_FLAG_RX | UPDATE_FLAG_TX);
+
 	if (!(grp = group_lookup(c_group, GROUP_CREATE)))
 		BUG();
 }
 
+static void proc_shutdown(void)
+{
+	if (proc_fd >= 0)
+		close(proc_fd);
+
+	xfree(proc_buf);
+}
+
 static int proc_probe(void)
 {
 	FILE *fd = fopen(c_path, "r");
@@ -165,6 +277,7 @@ static struct bmon_module proc_ops = {
 	.m_name		= "proc",
 	.m_type		= BMON_PRIMARY_MODULE,
 	.m_do		= proc_read,
+	.m_shutdown	= proc_shutdown,
 	.m_parse_opt	= proc_parse_opt,
 	.m_probe	= proc_probe,
 	.m_init		= proc_do_init,
@@ -0,0 +1,670 @@
+/*
+ * in_sysfs.c           /sys input (Linux)
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/input.h>
+#include <bmon/element.h>
+#include <bmon/group.h>
+#include <bmon/attr.h>
+#include <bmon/utils.h>
+#include <bmon/readbatch.h>
+
+#if defined SYS_LINUX
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+static const char *c_dir = "/sys";
+static const char *c_group = DEFAULT_GROUP;
+static const char *c_stats;
+static int c_rescan = 10;
+static int c_backend = READ_BACKEND_PREAD;
+
+static struct element_group *grp;
+static struct read_batch batch;
+
+/* netlink socket used to learn about new and removed links */
+static int event_fd = -1;
+static uint64_t last_scan;
+static int need_scan = 1;
+
+static unsigned int demand_version;
+static int fds_exhausted;
+
+struct attr_map {
+	const char *	name;
+	const char *	description;
+	const char *	unit;
+	const char *	rx_file;
+	const char *	tx_file;
+	int		attrid;
+	int		enabled;	/* selected with stats= */
+	int		wanted;		/* enabled and in demand */
+};
+
+#define A(NAME, UNIT, DESC, RX, TX) \
+	{ .name = NAME, .unit = UNIT, .description = DESC, \
+	  .rx_file = RX, .tx_file = TX }
+
+static struct attr_map sysfs_attrs[] = {
+	A("bytes",	"byte",	  "Bytes",		"rx_bytes", "tx_bytes"),
+	A("packets",	"number", "Packets",		"rx_packets", "tx_packets"),
+	A("errors",	"number", "Errors",		"rx_errors", "tx_errors"),
+	A("drop",	"number", "Dropped",		"rx_dropped", "tx_dropped"),
+	A("fifo",	"number", "FIFO Error",	"rx_fifo_errors",
+						"tx_fifo_errors"),
+	A("frame",	"number", "Frame Error",	"rx_frame_errors", NULL),
+	A("compressed",	"number", "Compressed",	"rx_compressed",
+						"tx_compressed"),
+	A("multicast",	"number", "Multicast",		"multicast", NULL),
+	A("collisions",	"number", "Collisions",	NULL, "collisions"),
+	A("len_err",	"number", "Length Error",	"rx_length_errors", NULL),
+	A("over_err",	"number", "Over Error",	"rx_over_errors", NULL),
+	A("crc_err",	"number", "CRC Error",		"rx_crc_errors", NULL),
+	A("missed_err",	"number", "Missed Error",	"rx_missed_errors", NULL),
+	A("abort_err",	"number", "Abort Error",	NULL, "tx_aborted_errors"),
+	A("carrier_err","number", "Carrier Error",	NULL, "tx_carrier_errors"),
+	A("hbeat_err",	"number", "Heartbeat Error",	NULL,
+						"tx_heartbeat_errors"),
+	A("window_err",	"number", "Window Error",	NULL, "tx_window_errors"),
+};
+
+#undef A
+
+#define NATTRS		ARRAY_SIZE(sysfs_attrs)
+
+/* ran out of descriptors, the file is opened for every read */
+#define FD_PER_READ	-2
+
+struct sysfs_link {
+	char *			l_name;
+	uint32_t		l_ifindex;
+	int			l_seen;
+
+	/*
+	 * descriptors of the rx and tx statistic files, -1 if unused,
+	 * FD_PER_READ if opened for every read
+	 */
+	int			l_fd[NATTRS][2];
+	char			l_buf[NATTRS][2][32];
+
+	struct list_head	l_list;
+	struct list_head	l_hash_list;
+};
+
+#define LINK_HASH_SIZE 1024
+
+static LIST_HEAD(link_list);
+static struct list_head link_hash[LINK_HASH_SIZE];
+
+static unsigned int link_hash_fn(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char) *name++) * 16777619u;
+
+	return hash % LINK_HASH_SIZE;
+}
+
+static struct sysfs_link *link_lookup(const char *name)
+{
+	struct sysfs_link *l;
+
+	list_for_each_entry(l, &link_hash[link_hash_fn(name)], l_hash_list)
+		if (!strcmp(l->l_name, name))
+			return l;
+
+	return NULL;
+}
+
+static int open_stat(const char *name, const char *file)
+{
+	char path[FILENAME_MAX];
+
+	if (!file)
+		return -1;
+
+	snprintf(path, sizeof(path), "%s/class/net/%s/statistics/%s",
+		 c_dir, name, file);
+
+	return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int read_u64(int fd, uint64_t *val)
+{
+	char buf[32];
+	ssize_t n;
+
+	if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) <= 0)
+		return -1;
+
+	buf[n] = '\0';
+	*val = strtoull(buf, NULL, 10);
+
+	return 0;
+}
+
+/*
+ * Opens a statistic file to keep open. Once out of descriptors, the
+ * file is opened for every read instead.
+ */
+static int keep_stat(const char *name, const char *file)
+{
+	int fd;
+
+	if (!file)
+		return -1;
+
+	if ((fd = open_stat(name, file)) >= 0 ||
+	    (errno != EMFILE && errno != ENFILE))
+		return fd;
+
+	if (!fds_exhausted) {
+		xwarn("Out of file descriptors (%s), statistic files are "
+		      "opened for every read\n", strerror(errno));
+		fds_exhausted = 1;
+	}
+
+	return FD_PER_READ;
+}
+
+static int read_stat(const char *name, const char *file, uint64_t *val)
+{
+	int fd, err;
+
+	if ((fd = open_stat(name, file)) < 0)
+		return -1;
+
+	err = read_u64(fd, val);
+	close(fd);
+
+	return err;
+}
+
+static uint64_t parse_u64(const char *buf, ssize_t len)
+{
+	uint64_t val = 0;
+	ssize_t i;
+
+	for (i = 0; i < len && buf[i] >= '0' && buf[i] <= '9'; i++)
+		val = val * 10 + (buf[i] - '0');
+
+	return val;
+}
+
+/* keep the statistic files of wanted attributes open, close all others */
+static void link_update_fds(struct sysfs_link *l)
+{
+	int i, j;
+
+	for (i = 0; i < NATTRS; i++) {
+		struct attr_map *m = &sysfs_attrs[i];
+		const char *file[2] = { m->rx_file, m->tx_file };
+
+		for (j = 0; j < 2; j++) {
+			if (m->wanted && l->l_fd[i][j] == -1)
+				l->l_fd[i][j] = keep_stat(l->l_name, file[j]);
+			else if (!m->wanted && l->l_fd[i][j] != -1) {
+				if (l->l_fd[i][j] >= 0)
+					close(l->l_fd[i][j]);
+				l->l_fd[i][j] = -1;
+			}
+		}
+	}
+}
+
+/* re-evaluates which attributes are wanted if the demand has changed */
+static void update_demand(void)
+{
+	struct sysfs_link *l;
+	int i;
+
+	if (demand_version == attr_demand_version)
+		return;
+
+	for (i = 0; i < NATTRS; i++) {
+		struct attr_map *m = &sysfs_attrs[i];
+		struct attr_def *def = attr_def_lookup_id(m->attrid);
+
+		m->wanted = m->enabled && def &&
+			    attr_def_demanded(def, ATTR_DEMAND_VALUE);
+	}
+
+	list_for_each_entry(l, &link_list, l_list)
+		link_update_fds(l);
+
+	demand_version = attr_demand_version;
+}
+
+static struct sysfs_link *link_alloc(const char *name)
+{
+	struct sysfs_link *l;
+	char path[FILENAME_MAX];
+	uint64_t ifindex = 0;
+	int i, fd;
+
+	snprintf(path, sizeof(path), "%s/class/net/%s/ifindex", c_dir, name);
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0) {
+		read_u64(fd, &ifindex);
+		close(fd);
+	}
+
+	l = xcalloc(1, sizeof(*l));
+	l->l_name = strdup(name);
+	l->l_ifindex = ifindex;
+
+	for (i = 0; i < NATTRS; i++)
+		l->l_fd[i][0] = l->l_fd[i][1] = -1;
+
+	link_update_fds(l);
+
+	list_add_tail(&l->l_list, &link_list);
+	list_add_tail(&l->l_hash_list, &link_hash[link_hash_fn(name)]);
+
+	return l;
+}
+
+static void link_free(struct sysfs_link *l)
+{
+	int i;
+
+	for (i = 0; i < NATTRS; i++) {
+		if (l->l_fd[i][0] >= 0)
+			close(l->l_fd[i][0]);
+		if (l->l_fd[i][1] >= 0)
+			close(l->l_fd[i][1]);
+	}
+
+	list_del(&l->l_list);
+	list_del(&l->l_hash_list);
+	xfree(l->l_name);
+	xfree(l);
+}
+
+static void rescan(void)
+{
+	struct sysfs_link *l, *n;
+	char topdir[FILENAME_MAX];
+	struct dirent *de;
+	DIR *d;
+
+	snprintf(topdir, sizeof(topdir), "%s/class/net", c_dir);
+
+	if (!(d = opendir(topdir)))
+		quit("Failed to open directory %s: %s\n",
+		     topdir, strerror(errno));
+
+	list_for_each_entry(l, &link_list, l_list)
+		l->l_seen = 0;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+
+		if (!(l = link_lookup(de->d_name)))
+			l = link_alloc(de->d_name);
+
+		l->l_seen = 1;
+	}
+
+	closedir(d);
+
+	list_for_each_entry_safe(l, n, &link_list, l_list)
+		if (!l->l_seen)
+			link_free(l);
+
+	last_scan = clock_ns();
+	need_scan = 0;
+}
+
+static void open_event_socket(void)
+{
+	struct sockaddr_nl snl = {
+		.nl_family = AF_NETLINK,
+		.nl_groups = RTMGRP_LINK,
+	};
+
+	event_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+			  NETLINK_ROUTE);
+	if (event_fd < 0)
+		return;
+
+	if (bind(event_fd, (struct sockaddr *) &snl, sizeof(snl)) < 0) {
+		close(event_fd);
+		event_fd = -1;
+	}
+}
+
+/*
+ * Returns true if link notifications have been received since the
+ * last call. The notifications themselves are not parsed, they only
+ * trigger a rescan of the directory.
+ */
+static int link_events_pending(void)
+{
+	char buf[4096];
+	int pending = 0;
+	ssize_t n;
+
+	if (event_fd < 0)
+		return 0;
+
+	while ((n = recv(event_fd, buf, sizeof(buf), 0)) > 0)
+		pending = 1;
+
+	/* notifications have been lost, rescan to be safe */
+	if (n < 0 && errno == ENOBUFS)
+		pending = 1;
+
+	return pending;
+}
+
+static struct element *link_element(struct sysfs_link *l)
+{
+	struct element *e;
+
+	if (l->l_ifindex && (e = element_find_index(grp, l->l_ifindex, NULL))) {
+		if (!strcmp(e->e_name, l->l_name))
+			return e;
+
+		element_set_index(e, 0);
+	}
+
+	if (!(e = element_lookup(grp, l->l_name, 0, NULL)))
+		return NULL;
+
+	element_set_index(e, l->l_ifindex);
+
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+		element_set_key_attr(e, ATTR_BYTES, ATTR_PACKETS);
+		element_set_usage_attr(e, ATTR_BYTES);
+
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
+
+	return e;
+}
+
+static void queue_link(struct sysfs_link *l)
+{
+	int i, j;
+
+	for (i = 0; i < NATTRS; i++)
+		for (j = 0; j < 2; j++)
+			if (l->l_fd[i][j] >= 0)
+				read_batch_add(&batch, l->l_fd[i][j],
+					       l->l_buf[i][j],
+					       sizeof(l->l_buf[i][j]));
+}
+
+/*
+ * Consumes the results of the requests queued by queue_link() starting
+ * at *req and advances it past them.
+ */
+static void read_link(struct sysfs_link *l, unsigned int *req)
+{
+	struct element *e;
+	uint64_t val[2];
+	int i, j, flags, vanished = 0;
+
+	e = link_element(l);
+
+	for (i = 0; i < NATTRS; i++) {
+		struct attr_map *m = &sysfs_attrs[i];
+
+		flags = 0;
+
+		for (j = 0; j < 2; j++) {
+			struct read_req *r;
+
+			val[j] = 0;
+
+			if (l->l_fd[i][j] == FD_PER_READ) {
+				if (read_stat(l->l_name,
+					      j ? m->tx_file : m->rx_file,
+					      &val[j]) < 0) {
+					if (errno == ENOENT || errno == ENODEV)
+						vanished = 1;
+					continue;
+				}
+
+				flags |= j ? UPDATE_FLAG_TX : UPDATE_FLAG_RX;
+				continue;
+			}
+
+			if (l->l_fd[i][j] < 0)
+				continue;
+
+			r = &batch.rb_reqs[(*req)++];
+
+			/* reads fail with ENODEV once the link is gone */
+			if (r->rr_res <= 0) {
+				vanished = 1;
+				continue;
+			}
+
+			val[j] = parse_u64(l->l_buf[i][j], r->rr_res);
+			flags |= j ? UPDATE_FLAG_TX : UPDATE_FLAG_RX;
+		}
+
+		if (e && flags && !vanished)
+			attr_update(e, m->attrid,
+				    val[0], val[1], flags);
+	}
+
+	if (vanished) {
+		need_scan = 1;
+		return;
+	}
+
+	if (e) {
+		element_notify_update(e, NULL);
+		element_lifesign(e, 1);
+	}
+}
+
+static void sysfs_read(void)
+{
+	struct sysfs_link *l;
+	unsigned int req = 0;
+
+	if (link_events_pending() ||
+	    (c_rescan > 0 &&
+	     clock_ns() - last_scan >= c_rescan * 1000000000ULL))
+		need_scan = 1;
+
+	update_demand();
+
+	if (need_scan)
+		rescan();
+
+	read_batch_reset(&batch);
+
+	list_for_each_entry(l, &link_list, l_list)
+		queue_link(l);
+
+	read_batch_submit(&batch);
+
+	list_for_each_entry(l, &link_list, l_list)
+		read_link(l, &req);
+}
+
+static void enable_stats(const char *list)
+{
+	char *copy, *tok, *save;
+	int i;
+
+	if (!list) {
+		for (i = 0; i < NATTRS; i++)
+			sysfs_attrs[i].enabled = 1;
+		return;
+	}
+
+	copy = strdup(list);
+
+	for (tok = strtok_r(copy, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save)) {
+		for (i = 0; i < NATTRS; i++)
+			if (!strcasecmp(tok, sysfs_attrs[i].name))
+				sysfs_attrs[i].enabled = 1;
+	}
+
+	xfree(copy);
+
+	/* key attributes are always required */
+	sysfs_attrs[0].enabled = sysfs_attrs[1].enabled = 1;
+}
+
+/*
+ * Up to two descriptors are kept open per statistic and link, raise
+ * the soft limit on descriptors as far as allowed.
+ */
+static void raise_fd_limit(void)
+{
+	struct rlimit rl;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0 || rl.rlim_cur >= rl.rlim_max)
+		return;
+
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+}
+
+static void sysfs_do_init(void)
+{
+	int i;
+
+	raise_fd_limit();
+
+	for (i = 0; i < LINK_HASH_SIZE; i++)
+		init_list_head(&link_hash[i]);
+
+	enable_stats(c_stats);
+
+	for (i = 0; i < NATTRS; i++) {
+		struct attr_map *m = &sysfs_attrs[i];
+		struct unit *u;
+
+		if (!(u = unit_lookup(m->unit)))
+			continue;
+
+		m->attrid = attr_def_add(m->name, m->description, u,
+					 ATTR_TYPE_COUNTER, 0);
+	}
+
+	open_event_socket();
+	read_batch_init(&batch, c_backend);
+
+	if (!(grp = group_lookup(c_group, GROUP_CREATE)))
+		BUG();
+}
+
+static void sysfs_shutdown(void)
+{
+	struct sysfs_link *l, *n;
+
+	list_for_each_entry_safe(l, n, &link_list, l_list)
+		link_free(l);
+
+	if (event_fd >= 0)
+		close(event_fd);
+
+	read_batch_exit(&batch);
+}
+
+static void print_help(void)
+{
+	printf(
+	"sysfs - sysfs statistic collector for Linux\n" \
+	"\n" \
+	"  Reads statistics from sysfs (/sys/class/net). The statistic files\n" \
+	"  are kept open while descriptors last and re-read on every read.\n" \
+	"  The directory is only rescanned when a link notification is\n" \
+	"  received or periodically.\n" \
+	"  Author: Thomas Graf <tgraf@suug.ch>\n" \
+	"\n" \
+	"  Options:\n" \
+	"    dir=DIR        Sysfs directory (default: /sys)\n" \
+	"    group=NAME     Name of group\n" \
+	"    rescan=SECS    Rescan interval, 0 to disable (default: 10)\n" \
+	"    stats=LIST     Counters to read, e.g. bytes,packets,errors\n" \
+	"                   (default: all consumed by the outputs)\n" \
+	"    io=BACKEND     Read backend, pread or uring (default: pread)\n");
+}
+
+static void sysfs_parse_opt(const char *type, const char *value)
+{
+	if (!strcasecmp(type, "dir") && value)
+		c_dir = value;
+	else if (!strcasecmp(type, "group") && value)
+		c_group = value;
+	else if (!strcasecmp(type, "rescan") && value)
+		c_rescan = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "stats") && value)
+		c_stats = value;
+	else if (!strcasecmp(type, "io") && value) {
+		if ((c_backend = read_backend_lookup(value)) < 0)
+			quit("Unknown read backend \"%s\"\n", value);
+	}
+	else if (!strcasecmp(type, "help")) {
+		print_help();
+		exit(0);
+	}
+}
+
+static int sysfs_probe(void)
+{
+	char topdir[FILENAME_MAX];
+	DIR *d;
+
+	snprintf(topdir, sizeof(topdir), "%s/class/net", c_dir);
+
+	if ((d = opendir(topdir))) {
+		closedir(d);
+		return 1;
+	}
+
+	return 0;
+}
+
+static struct bmon_module sysfs_ops = {
+	.m_name		= "sysfs",
+	.m_type		= BMON_PRIMARY_MODULE,
+	.m_do		= sysfs_read,
+	.m_shutdown	= sysfs_shutdown,
+	.m_parse_opt	= sysfs_parse_opt,
+	.m_probe	= sysfs_probe,
+	.m_init		= sysfs_do_init,
+};
+
+static void __init sysfs_init(void)
+{
+	input_register(&sysfs_ops);
+}
+
+#endif
@@ -31,13 +31,8 @@ static struct bmon_subsys input_subsys;
 
 struct reader_timing rtiming;
 
-#define FOREACH_SECONDARY_INPUT(F)				 \
-	do {							 \
-		struct bmon_module *m;				 \
-		list_for_each_entry(m, &input_subsys.s_secondary_list, m_list) \
-			if (m->m_flags & BMON_MODULE_ENABLED && m->m_##F)		 \
-				m->m_##F ();			 \
-	} while (0)
+/* time at which the data of the input currently being read was sampled */
+static timestamp_t sample_time;
 
 void input_register(struct bmon_module *m)
 {
@@ -88,12 +83,44 @@ static void find_primary(void)
 	}
 }
 
+/**
+ * Set the sampling time of the current read
+ * @arg ts		timestamp or NULL to use the current time
+ *
+ * The sampling time is used for all elements updated without an
+ * explicit timestamp, see element_notify_update(). It is taken before
+ * each input is read. Inputs may call this again once the data has
+ * actually been retrieved.
+ */
+void input_stamp(timestamp_t *ts)
+{
+	if (ts)
+		copy_timestamp(&sample_time, ts);
+	else
+		update_timestamp(&sample_time);
+}
+
+timestamp_t *input_timestamp(void)
+{
+	return &sample_time;
+}
+
+static void read_input(struct bmon_module *m)
+{
+	input_stamp(NULL);
+	m->m_do();
+}
+
 void input_read(void)
 {
+	struct bmon_module *m;
+
 	if (input_subsys.s_primary)
-		input_subsys.s_primary->m_do();
+		read_input(input_subsys.s_primary);
 
-	FOREACH_SECONDARY_INPUT(do);
+	list_for_each_entry(m, &input_subsys.s_secondary_list, m_list)
+		if (m->m_flags & BMON_MODULE_ENABLED && m->m_do)
+			read_input(m);
 }
 
 void input_set(const char *name)
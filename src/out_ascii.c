@@ -44,17 +44,22 @@ static struct graph_cfg graph_cfg = {
 	.gc_noise = '.',
 	.gc_unknown = '?',
 	.gc_height = 6,
+	.gc_cf = HISTORY_CF_MAX,
 };
 
+static struct bmon_module ascii_ops;
+
 static diagram_type_t c_diagram_type = D_LIST;
 static char *c_hist = "second";
 static int c_quit_after = -1;
+static struct output_buffer frame;
+static FILE *fd;
 
 static void print_list(struct element *e)
 {
 	char *rxu1 = "", *txu1 = "", *rxu2 = "", *txu2 = "";
 	double rx1 = 0.0f, tx1 = 0.0f, rx2 = 0.0f, tx2 = 0.0f;
-	int rx1prec, tx1prec, rx2prec, tx2prec;
+	int rx1prec = 0, tx1prec = 0, rx2prec = 0, tx2prec = 0;
 	char pad[IFNAMSIZ + 32];
 	struct attr *a;
 
@@ -79,20 +84,21 @@ static void print_list(struct element *e)
 		strncat(pad, ")", sizeof(pad) - strlen(pad) - 1);
 	}
 
-	printf("  %-18s %8.*f%-3s %8.*f%-3s ",
-	       pad, rx1prec, rx1, rxu1, rx2prec, rx2, rxu2);
+	fprintf(fd, "  %-18s %8.*f%-3s %8.*f%-3s ",
+		pad, rx1prec, rx1, rxu1, rx2prec, rx2, rxu2);
 
 	if (e->e_rx_usage == FLT_MAX)
-		printf("   ");
+		fprintf(fd, "   ");
 	else
-		printf("%2.0f%%", e->e_rx_usage);
+		fprintf(fd, "%2.0f%%", e->e_rx_usage);
 
-	printf("  %8.*f%-3s %8.*f%-3s ", tx1prec, tx1, txu1, tx2prec, tx2, txu2);
+	fprintf(fd, "  %8.*f%-3s %8.*f%-3s ",
+		tx1prec, tx1, txu1, tx2prec, tx2, txu2);
 
 	if (e->e_tx_usage == FLT_MAX)
-		printf("   \n");
+		fprintf(fd, "   \n");
 	else
-		printf("%2.0f%%\n", e->e_tx_usage);
+		fprintf(fd, "%2.0f%%\n", e->e_tx_usage);
 }
 
 static void print_attr_detail(struct element *e, struct attr *a, void *arg)
@@ -107,22 +113,22 @@ static void print_attr_detail(struct element *e, struct attr *a, void *arg)
 				   a->a_def->ad_unit,
 				   &tx_u, &txprec);
 
-	printf("  %-14s %12.2f%-3s %12.2f%-3s\n",
-	       a->a_def->ad_description, rx, rx_u, tx, tx_u);
+	fprintf(fd, "  %-14s %12.2f%-3s %12.2f%-3s\n",
+		a->a_def->ad_description, rx, rx_u, tx, tx_u);
 }
 
 static void print_details(struct element *e)
 {
-	printf(" %s", e->e_name);
+	fprintf(fd, " %s", e->e_name);
 
 	if (e->e_id)
-		printf(" (%u)", e->e_id);
+		fprintf(fd, " (%u)", e->e_id);
 
-	printf("\n");
+	fprintf(fd, "\n");
 
 	element_foreach_attr(e, print_attr_detail, NULL);
 
-	printf("\n");
+	fprintf(fd, "\n");
 }
 
 static void print_table(struct graph *g, struct graph_table *tbl, const char *hdr)
@@ -132,13 +138,13 @@ static void print_table(struct graph *g, struct graph_table *tbl, const char *hd
 	if (!tbl->gt_table)
 		return;
 
-	printf("%s   %s\n", hdr, tbl->gt_y_unit);
+	fprintf(fd, "%s   %s\n", hdr, tbl->gt_y_unit);
 
 	for (i = (g->g_cfg.gc_height - 1); i >= 0; i--)
-		printf("%8.2f %s\n", tbl->gt_scale[i],
+		fprintf(fd, "%8.2f %s\n", tbl->gt_scale[i],
 		    tbl->gt_table + (i * graph_row_size(&g->g_cfg)));
 	
-	printf("         1   5   10   15   20   25   30   35   40   " \
+	fprintf(fd, "         1   5   10   15   20   25   30   35   40   " \
 		"45   50   55   60\n");
 }
 
@@ -159,8 +165,8 @@ static void __print_graph(struct element *e, struct attr *a, void *arg)
 		g = graph_alloc(h, &graph_cfg);
 		graph_refill(g, h);
 
-		printf("Interface: %s\n", e->e_name);
-		printf("Attribute: %s\n", a->a_def->ad_description);
+		fprintf(fd, "Interface: %s\n", e->e_name);
+		fprintf(fd, "Attribute: %s\n", a->a_def->ad_description);
 
 		print_table(g, &g->g_rx, "RX");
 		print_table(g, &g->g_tx, "TX");
@@ -196,29 +202,42 @@ static void ascii_draw_element(struct element_group *g, struct element *e,
 static void ascii_draw_group(struct element_group *g, void *arg)
 {
 	if (c_diagram_type == D_LIST)
-		printf("%-19s%10s %11s      %%%10s %11s      %%\n",
-		       g->g_hdr->gh_title,
-		       g->g_hdr->gh_column[0],
-		       g->g_hdr->gh_column[1],
-		       g->g_hdr->gh_column[2],
-		       g->g_hdr->gh_column[3]);
+		fprintf(fd, "%-19s%10s %11s      %%%10s %11s      %%\n",
+			g->g_hdr->gh_title,
+			g->g_hdr->gh_column[0],
+			g->g_hdr->gh_column[1],
+			g->g_hdr->gh_column[2],
+			g->g_hdr->gh_column[3]);
 	else
-		printf("%s\n", g->g_hdr->gh_title);
+		fprintf(fd, "%s\n", g->g_hdr->gh_title);
 
 	group_foreach_element(g, ascii_draw_element, NULL);
 }
 
 static void ascii_draw(void)
 {
+	fd = output_buffer_open(&frame);
 	group_foreach(ascii_draw_group, NULL);
+	output_buffer_close(&frame);
 
 	if (c_quit_after > 0)
 		if (--c_quit_after == 0)
-			exit(0);
+			do_quit = 1;
+}
+
+static void ascii_flush(void)
+{
+	output_buffer_write(&frame, stdout);
 }
 
 static int ascii_probe(void)
 {
+	/* the list only shows key attributes, which are always collected */
+	if (c_diagram_type == D_LIST)
+		ascii_ops.m_flags |= BMON_MODULE_DEMAND;
+	else if (c_diagram_type == D_GRAPH)
+		history_def_view(history_def_lookup(c_hist));
+
 	return 1;
 }
 
@@ -245,6 +264,7 @@ static void print_help(void)
 	"    nchar=CHAR     Noise character (default: ':')\n" \
 	"    uchar=CHAR     Unknown character (default: '?')\n" \
 	"    height=NUM     Height of graph (default: 6)\n" \
+	"    cf=FUNC        Consolidation drawn, avg|min|max (default: max)\n" \
 	"    xunit=UNIT     X-Axis Unit (default: seconds)\n" \
 	"    yunit=UNIT     Y-Axis Unit (default: dynamic)\n" \
 	"    quitafter=NUM  Quit bmon after NUM outputs\n");
@@ -284,6 +304,10 @@ static void ascii_parse_opt(const char *type, const char *value)
 #endif
 	else if (!strcasecmp(type, "height") && value)
 		graph_cfg.gc_height = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "cf") && value) {
+		if ((graph_cfg.gc_cf = history_cf_lookup(value)) < 0)
+			quit("Unknown consolidation function '%s'\n", value);
+	}
 	else if (!strcasecmp(type, "quitafter") && value)
 		c_quit_after = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "help")) {
@@ -297,6 +321,7 @@ static struct bmon_module ascii_ops = {
 	.m_name		= "ascii",
 	.m_type		= BMON_PRIMARY_MODULE,
 	.m_do		= ascii_draw,
+	.m_flush	= ascii_flush,
 	.m_probe	= ascii_probe,
 	.m_parse_opt	= ascii_parse_opt,
 };
@@ -46,6 +46,8 @@ enum {
 	KEY_COLLECT_HISTORY	= 'H',
 };
 
+static struct bmon_module curses_ops;
+
 #define DETAILS_COLS		40
 
 #define LIST_COL_1		31
@@ -118,6 +120,7 @@ static struct graph_cfg c_graph_cfg = {
 	.gc_background		= '.',
 	.gc_noise		= ':',
 	.gc_unknown		= '?',
+	.gc_cf			= HISTORY_CF_MAX,
 };
 
 #define NEXT_ROW()			\
@@ -260,13 +263,81 @@ static void draw_attr_detail(struct element *e, struct attr *a, void *arg)
 	da->nattr++;
 }
 
+static const struct {
+	const char *	name;
+	double		q;
+} detail_quantiles[] = {
+	{ "p50", 0.5 },
+	{ "p90", 0.9 },
+	{ "p99", 0.99 },
+	{ "p99.9", 0.999 },
+};
+
+/* history the rate quantiles of the current attribute are shown for */
+static struct history *quantile_history(void)
+{
+	struct history_def *def = history_current();
+
+	if (!current_attr || !def ||
+	    !(def->hd_flags & HISTORY_DEF_FLAG_QUANTILES))
+		return NULL;
+
+	history_def_view(def);
+	attr_demand_attr(current_element, current_attr,
+			 ATTR_DEMAND_VALUE | ATTR_DEMAND_HISTORY);
+
+	return history_lookup(current_attr, def);
+}
+
+static void draw_quantiles(struct history *h)
+{
+	char *rx_u, *tx_u, buf1[32], buf2[32];
+	int rxprec, txprec, i, ncol;
+	double rx, tx;
+
+	NEXT_ROW();
+	put_line(" %s rate per %s", current_attr->a_def->ad_description,
+		 h->h_definition->hd_name);
+
+	for (i = 0; i < ARRAY_SIZE(detail_quantiles); i++) {
+		if (i % detail_cols == 0)
+			NEXT_ROW();
+
+		ncol = ((i % detail_cols) * DETAILS_COLS) - 1;
+		move(row, ncol);
+		if (ncol > 0)
+			addch(ACS_VLINE);
+
+		if (history_quantile(h, 0, detail_quantiles[i].q, &rx) < 0 ||
+		    history_quantile(h, 1, detail_quantiles[i].q, &tx) < 0) {
+			put_line(" %-14.14s %8s%-3s %8s%-3s\n",
+				 detail_quantiles[i].name, "-", "", "-", "");
+			continue;
+		}
+
+		rx = unit_value2str(rx, current_attr->a_def->ad_unit,
+				    &rx_u, &rxprec);
+		tx = unit_value2str(tx, current_attr->a_def->ad_unit,
+				    &tx_u, &txprec);
+
+		put_line(" %-14.14s %8s%-3s %8s%-3s\n",
+			 detail_quantiles[i].name,
+			 float2str(rx, 8, rxprec, buf1, sizeof(buf1)), rx_u,
+			 float2str(tx, 8, txprec, buf2, sizeof(buf2)), tx_u);
+	}
+}
+
 static void draw_details(void)
 {
+	struct history *h;
 	int i;
 	struct detail_arg arg = {
 		.nattr = 0,
 	};
 
+	/* the details list every attribute of the selected element */
+	attr_demand_all(ATTR_DEMAND_VALUE);
+
 	if (!current_element->e_nattrs)
 		return;
 
@@ -291,6 +362,9 @@ static void draw_details(void)
 	 */
 	for (i = 1; i < detail_cols; i++)
 		mvaddch(row, (i * DETAILS_COLS - 1), ACS_VLINE);
+
+	if ((h = quantile_history()))
+		draw_quantiles(h);
 }
 
 static void print_message(const char *text)
@@ -474,7 +548,7 @@ static int lines_required_for_graph(void)
 
 static int lines_required_for_details(void)
 {
-	int lines = 1;
+	int lines = 1, n;
 
 	if (c_show_details && current_element) {
 		lines++;	/* header */
@@ -487,6 +561,11 @@ static int lines_required_for_details(void)
 		lines += (current_element->e_nattrs / detail_cols);
 		if (current_element->e_nattrs % detail_cols)
 			lines++;
+
+		if (quantile_history()) {
+			n = ARRAY_SIZE(detail_quantiles);
+			lines += 1 + (n + detail_cols - 1) / detail_cols;
+		}
 	}
 
 	return lines;
@@ -688,9 +767,15 @@ static void draw_table(struct graph *g, struct graph_table *tbl,
 	move(++row, ncol);
 	put_line("%8s", tbl->gt_y_unit ? : "");
 
-	snprintf(buf, sizeof(buf), "(%s %s/%s)",
-		 hdr, a->a_def->ad_description,
-		 h ? h->h_definition->hd_name : "?");
+	if (h && h->h_definition->hd_base)
+		snprintf(buf, sizeof(buf), "(%s %s/%s %s)",
+			 hdr, a->a_def->ad_description,
+			 h->h_definition->hd_name,
+			 history_cf_name(g->g_cfg.gc_cf));
+	else
+		snprintf(buf, sizeof(buf), "(%s %s/%s)",
+			 hdr, a->a_def->ad_description,
+			 h ? h->h_definition->hd_name : "?");
 
 	draw_graph_centered(g, row, ncol, buf);
 
@@ -756,6 +841,11 @@ static void draw_attr_graph(struct element *e, struct attr *a, void *arg)
 		struct history *h;
 
 		sel = history_current();
+		history_def_view(sel);
+
+		/* graphed attributes follow the selection */
+		attr_demand_attr(e, a, ATTR_DEMAND_VALUE |
+				       ATTR_DEMAND_HISTORY);
 		c_graph_cfg.gc_unit = a->a_def->ad_unit;
 
 		list_for_each_entry(h, &a->a_history_list, h_list) {
@@ -1065,7 +1155,12 @@ static void curses_draw(void)
 
 out:
 	attrset(0);
-	refresh();
+	wnoutrefresh(stdscr);
+}
+
+static void curses_flush(void)
+{
+	doupdate();
 }
 
 static int handle_input(int ch)
@@ -1124,7 +1219,7 @@ static int handle_input(int ch)
 
 		case KEY_COLLECT_HISTORY:
 			if (current_attr) {
-				attr_collect_history(current_attr);
+				attr_collect_history(current_element, current_attr);
 				return 1;
 			}
 			break;
@@ -1191,6 +1286,8 @@ static int handle_input(int ch)
 
 static void curses_pre(void)
 {
+	int redraw = 0;
+
 	for (;;) {
 		int ch = getch();
 
@@ -1198,8 +1295,11 @@ static void curses_pre(void)
 			break;
 
 		if (handle_input(ch))
-			curses_draw();
+			redraw = 1;
 	}
+
+	if (redraw)
+		output_redraw(&curses_ops);
 }
 
 static int curses_probe(void)
@@ -1222,6 +1322,7 @@ static void print_module_help(void)
 	"    uchar=CHAR     Unknown character (default: '?')\n" \
 	"    gheight=NUM    Height of graph (default: 6)\n" \
 	"    gwidth=NUM     Width of graph (default: 60)\n" \
+	"    cf=FUNC        Consolidation drawn, avg|min|max (default: max)\n" \
 	"    ngraph=NUM     Number of graphs (default: 1)\n" \
 	"    nocolors       Do not use colors\n" \
 	"    graph          Show graphical stats by default\n" \
@@ -1243,6 +1344,10 @@ static void curses_parse_opt(const char *type, const char *value)
 		c_graph_cfg.gc_height = strtol(value, NULL, 0);
 	else if (!strcasecmp(type, "gwidth") && value)
 		c_graph_cfg.gc_width = strtol(value, NULL, 0);
+	else if (!strcasecmp(type, "cf") && value) {
+		if ((c_graph_cfg.gc_cf = history_cf_lookup(value)) < 0)
+			quit("Unknown consolidation function '%s'\n", value);
+	}
 	else if (!strcasecmp(type, "ngraph")) {
 		c_ngraph = strtol(value, NULL, 0);
 		c_show_graph = !!c_ngraph;
@@ -1265,8 +1370,10 @@ static struct bmon_module curses_ops = {
 	.m_shutdown	= curses_shutdown,
 	.m_pre		= curses_pre,
 	.m_do		= curses_draw,
+	.m_flush	= curses_flush,
 	.m_parse_opt	= curses_parse_opt,
 	.m_probe	= curses_probe,
+	.m_flags	= BMON_MODULE_INTERACTIVE | BMON_MODULE_DEMAND,
 };
 
 static void __init do_curses_init(void)
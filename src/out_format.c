@@ -31,11 +31,14 @@
 #include <bmon/input.h>
 #include <bmon/utils.h>
 #include <bmon/attr.h>
+#include <bmon/history.h>
 
 static int c_quit_after = -1;
 static char *c_format;
+static char *c_quantiles;
 static int c_debug = 0;
 static FILE *c_fd;
+static struct output_buffer frame;
 
 enum {
 	OT_STRING,
@@ -50,6 +53,44 @@ static struct out_token {
 static int token_index;
 static int out_tokens_size;
 
+static struct bmon_module format_ops;
+
+/* history definition the quantiles are taken from */
+static struct history_def *quant_def;
+
+/*
+ * Parses the type of a quantile placeholder, e.g. "rxp99:". The first
+ * two digits are the percentile, further digits its decimals: p05 is
+ * the 0.05, p99 the 0.99 and p999 the 0.999 quantile.
+ */
+static int parse_quantile(const char *type, int *dir, double *q)
+{
+	const char *digits = type + 3;
+	double div = 1.0;
+	int n = 0;
+
+	if (!strncasecmp(type, "rxp", 3))
+		*dir = 0;
+	else if (!strncasecmp(type, "txp", 3))
+		*dir = 1;
+	else
+		return -1;
+
+	for (type += 3; isdigit((unsigned char) *type); type++) {
+		n = n * 10 + (*type - '0');
+		div *= 10.0;
+	}
+
+	if (*type != ':' || type - digits < 2)
+		quit("Invalid quantile \"%.*s\", expected two digits of "
+		     "percentile and optional decimals, e.g. p05, p50 or "
+		     "p999\n", (int) strcspn(digits - 3, ":"), digits - 3);
+
+	*q = n / div;
+
+	return 0;
+}
+
 static char *get_token(struct element_group *g, struct element *e,
 		       const char *token, char *buf, size_t len)
 {
@@ -75,7 +116,7 @@ static char *get_token(struct element_group *g, struct element *e,
 			snprintf(buf, len, "%u", e->e_nattrs);
 			return buf;
 		} else if (!strcasecmp(n, "lifecycles")) {
-			snprintf(buf, len, "%u", e->e_lifecycles);
+			snprintf(buf, len, "%d", element_lifecycles(e));
 			return buf;
 		} else if (!strcasecmp(n, "level")) {
 			snprintf(buf, len, "%u", e->e_level);
@@ -98,11 +139,35 @@ static char *get_token(struct element_group *g, struct element *e,
 				list_empty(&e->e_childs) ? 0 : 1);
 			return buf;
 		}
+	} else if (!strncasecmp(token, "read:", 5)) {
+		const char *n = token + 5;
+
+		if (!strcasecmp(n, "count")) {
+			snprintf(buf, len, "%lu", rtiming.rt_reads);
+			return buf;
+		} else if (!strcasecmp(n, "wakeups")) {
+			snprintf(buf, len, "%lu", rtiming.rt_wakeups);
+			return buf;
+		} else if (!strcasecmp(n, "error")) {
+			snprintf(buf, len, "%.2f", rtiming.rt_variance.v_error);
+			return buf;
+		} else if (!strcasecmp(n, "maxerror")) {
+			snprintf(buf, len, "%.2f", rtiming.rt_variance.v_max);
+			return buf;
+		} else if (!strcasecmp(n, "avgerror")) {
+			snprintf(buf, len, "%.2f", rtiming.rt_reads ?
+				 rtiming.rt_variance.v_total / rtiming.rt_reads :
+				 0.0f);
+			return buf;
+		}
 	} else if (!strncasecmp(token, "attr:", 5)) {
 		const char *type = token + 5;
 		char *name = strchr(type, ':');
 		struct attr_def *def;
+		struct history *h;
 		struct attr *a;
+		double q, v;
+		int dir;
 
 		if (!name) {
 			fprintf(stderr, "Invalid attribute field \"%s\"\n",
@@ -124,7 +189,14 @@ static char *get_token(struct element_group *g, struct element *e,
 			goto out;
 		}
 
-		if (!strncasecmp(type, "rx:", 3)) {
+		if (parse_quantile(type, &dir, &q) == 0) {
+			if (!(h = history_lookup(a, quant_def)) ||
+			    history_quantile(h, dir, q, &v) < 0)
+				goto out;
+
+			snprintf(buf, len, "%.2f", v);
+			return buf;
+		} else if (!strncasecmp(type, "rx:", 3)) {
 			snprintf(buf, len, "%lu", a->a_rx_rate.r_total);
 			return buf;
 		} else if (!strncasecmp(type, "tx:", 3)) {
@@ -145,6 +217,7 @@ out:
 
 static void draw_element(struct element_group *g, struct element *e, void *arg)
 {
+	FILE *fd = arg;
 	int i;
 
 	for (i = 0; i < token_index; i++) {
@@ -160,17 +233,23 @@ static void draw_element(struct element_group *g, struct element *e, void *arg)
 			BUG();
 
 		if (p)
-			fprintf(c_fd, "%s", p);
+			fprintf(fd, "%s", p);
 	}
 }
 
 static void format_draw(void)
 {
-	group_foreach_recursive(draw_element, NULL);
+	group_foreach_recursive(draw_element, output_buffer_open(&frame));
+	output_buffer_close(&frame);
 
 	if (c_quit_after > 0)
 		if (--c_quit_after == 0)
-			exit(0);
+			do_quit = 1;
+}
+
+static void format_flush(void)
+{
+	output_buffer_write(&frame, c_fd);
 }
 
 static inline void add_token(int type, char *data)
@@ -195,6 +274,53 @@ static inline void add_token(int type, char *data)
 	token_index++;
 }
 
+static void demand_quantiles(void)
+{
+	if (quant_def)
+		return;
+
+	if (c_quantiles) {
+		if (!(quant_def = history_def_lookup(c_quantiles)))
+			quit("Unknown history definition \"%s\"\n",
+			     c_quantiles);
+
+		quant_def->hd_flags |= HISTORY_DEF_FLAG_QUANTILES;
+	} else if (!(quant_def = history_quantile_def()))
+		quit("No history definition collects quantiles, " \
+		     "use quantiles=NAME\n");
+
+	history_def_view(quant_def);
+}
+
+/*
+ * Declare the attributes referenced by the format string, only these
+ * need to be collected.
+ */
+static void demand_tokens(void)
+{
+	int i, dir;
+	double q;
+
+	for (i = 0; i < token_index; i++) {
+		char *t = out_tokens[i].ot_str, *name;
+
+		if (out_tokens[i].ot_type != OT_TOKEN)
+			continue;
+
+		if (strncasecmp(t, "attr:", 5) || !(name = strchr(t + 5, ':')))
+			continue;
+
+		if (parse_quantile(t + 5, &dir, &q) == 0) {
+			attr_demand(name + 1, ATTR_DEMAND_VALUE |
+					      ATTR_DEMAND_HISTORY);
+			demand_quantiles();
+		} else
+			attr_demand(name + 1, ATTR_DEMAND_VALUE);
+	}
+
+	format_ops.m_flags |= BMON_MODULE_DEMAND;
+}
+
 static int format_probe(void)
 {
 	int new_one = 1;
@@ -271,6 +397,8 @@ out:
 			printf(">>%s<\n", out_tokens[i].ot_str);
 	}
 
+	demand_tokens();
+
 	return 1;
 
 unexpected_end:
@@ -298,6 +426,8 @@ static void print_help(void)
 	"    fmt=FORMAT     Format string\n" \
 	"    stderr         Write to stderr instead of stdout\n" \
 	"    quitafter=NUM  Quit bmon after NUM outputs\n" \
+	"    quantiles=NAME History definition to take quantiles from\n" \
+	"                   (default: first with quantiles enabled)\n" \
 	"\n" \
 	"  Placeholders:\n" \
 	"    group:nelements       Number of elements this group\n" \
@@ -317,6 +447,15 @@ static void print_help(void)
 	"        :tx:<name>        TX counter of attribute <name>\n" \
 	"        :rxrate:<name>    RX rate of attribute <name>\n" \
 	"        :txrate:<name>    TX rate of attribute <name>\n" \
+	"        :rxpNN:<name>     RX rate quantile, NN is the percentile with\n" \
+	"                          two digits and optional decimals, e.g.\n" \
+	"                          rxp05, rxp50, rxp99 or rxp999 (99.9%%)\n" \
+	"        :txpNN:<name>     TX rate quantile\n" \
+	"    read:count            Number of reads performed\n" \
+	"        :wakeups          Number of main loop wakeups\n" \
+	"        :error            Lateness of last read (%% of read interval)\n" \
+	"        :maxerror         Maximum lateness of a read\n" \
+	"        :avgerror         Average lateness of a read\n" \
 	"\n" \
 	"  Supported Escape Sequences: \\n, \\t, \\r, \\v, \\b, \\f, \\a\n" \
 	"\n" \
@@ -346,6 +485,9 @@ static void format_parse_opt(const char *type, const char *value)
 		if (c_format)
 			free(c_format);
 		c_format = strdup(value);
+	} else if (!strcasecmp(type, "quantiles") && value) {
+		xfree(c_quantiles);
+		c_quantiles = strdup(value);
 	} else if (!strcasecmp(type, "quitafter") &&
 			       value)
 		c_quit_after = strtol(value, NULL, 0);
@@ -359,6 +501,7 @@ static struct bmon_module format_ops = {
 	.m_name		= "format",
 	.m_type		= BMON_PRIMARY_MODULE,
 	.m_do		= format_draw,
+	.m_flush	= format_flush,
 	.m_probe	= format_probe,
 	.m_parse_opt	= format_parse_opt,
 };
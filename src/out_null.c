@@ -59,6 +59,7 @@ static struct bmon_module null_ops = {
 	.m_do		= null_draw,
 	.m_probe	= null_probe,
 	.m_parse_opt	= null_parse_opt,
+	.m_flags	= BMON_MODULE_DEMAND,
 };
 
 static void __init null_init(void)
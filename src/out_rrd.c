@@ -41,54 +41,39 @@ static int c_rra_index = 0;
 static int c_update_interval = 1;
 static int c_always_unique = 0;
 
-static void create_rrd(char *file, struct element *e)
+/*
+ * Updates are rendered from the element tree by rrd_draw() and written
+ * to the databases by rrd_flush() which runs on the output thread.
+ */
+struct rrd_update
+{
+	char			ru_file[FILENAME_MAX];
+	char *			ru_ds[256];
+	int			ru_nds;
+	char			ru_template[256];
+	char			ru_data[1024];
+	struct list_head	ru_list;
+};
+
+static LIST_HEAD(frame);
+
+static void create_rrd(struct rrd_update *ru)
 {
 	char *argv[256];
 	char nows[32];
-	int i = 0, m, ul;
-	struct attr *a;
-
-	memset(argv, 0, sizeof(argv));
+	int i = 0, m;
 
 	snprintf(nows, sizeof(nows), "%lld", (unsigned long long) (time(0) - 1));
 
 	argv[i++] = "create";
-	argv[i++] = file;
+	argv[i++] = ru->ru_file;
 	argv[i++] = "--start";
 	argv[i++] = nows;
 	argv[i++] = "--step";
 	argv[i++] = c_step;
 
-	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
-		char ds[128];
-
-		if (i >= (253 - c_rra_index))
-			goto overflow;
-
-		snprintf(ds, sizeof(ds), "DS:%s_rx:%s:%s:U:U",
-			a->a_def->ad_name,
-			a->a_def->ad_type == ATTR_TYPE_COUNTER ?
-				"COUNTER" : "GAUGE",
-			c_heartbeat);
-
-		argv[i++] = strdup(ds);
-
-		if (i >= (253 - c_rra_index))
-			goto overflow;
-
-		snprintf(ds, sizeof(ds), "DS:%s_tx:%s:%s:U:U",
-			a->a_def->ad_name,
-			a->a_def->ad_type == ATTR_TYPE_COUNTER ?
-				"COUNTER" : "GAUGE",
-			c_heartbeat);
-
-		argv[i++] = strdup(ds);
-	}
-	
-	ul = i;
-
-	if (i + c_rra_index >= 255)
-		goto overflow;
+	for (m = 0; m < ru->ru_nds; m++)
+		argv[i++] = ru->ru_ds[m];
 
 	for (m = 0; m < c_rra_index; m++)
 		argv[i++] = c_rra[m];
@@ -98,95 +83,91 @@ static void create_rrd(char *file, struct element *e)
 
 	if (rrd_create(i, argv) < 0)
 		fprintf(stderr, "rrd_create failed: %s\n", rrd_get_error());
-
-	for (i = 6; i < ul && argv[i]; i++)
-		free(argv[i]);
-
-	return;
-
-overflow:
-	quit("Argument overflow, blame the RRD API\n");
 }
 
-static void update_rrd(char *file, struct element *e)
+static void update_rrd(struct rrd_update *ru)
 {
 	char *argv[6];
-	char template[256];
-	char data[1024];
-	int i = 0;
-	struct attr *a;
 
 	memset(argv, 0, sizeof(argv));
 
-	argv[i++] = "update";
-	argv[i++] = file;
-	argv[i++] = "--template";
-
-	memset(template, 0, sizeof(template));
-
-	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
-		if (template[0])
-			strncat(template, ":",
-			    sizeof(template) - strlen(template) - 1);
-		strncat(template, a->a_def->ad_name,
-		    sizeof(template) - strlen(template) - 1);
-		strncat(template, "_rx",
-		    sizeof(template) - strlen(template) - 1);
-		strncat(template, ":",
-		    sizeof(template) - strlen(template) - 1);
-		strncat(template, a->a_def->ad_name,
-		    sizeof(template) - strlen(template) - 1);
-		strncat(template, "_tx",
-		    sizeof(template) - strlen(template) - 1);
-	}
-
-	argv[i++] = template;
-
-	snprintf(data, sizeof(data), "%" PRId64,
-	    rtiming.rt_last_read.tv_sec);
-
-	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
-		char valuepair[64];
+	argv[0] = "update";
+	argv[1] = ru->ru_file;
+	argv[2] = "--template";
+	argv[3] = ru->ru_template;
+	argv[4] = ru->ru_data;
 
-		snprintf(valuepair, sizeof(valuepair),
-		    "%s%" PRId64 ":%" PRId64,
-		    data[0] ? ":" : "", 
-		    	a->a_rx_rate.r_total,
-		    	a->a_tx_rate.r_total);
-
-		strncat(data, valuepair,
-		    sizeof(data) - strlen(data) - 1);
-	}
-
-	argv[4] = data;
-
-	/*for (m = 0; m < 5; m++)
-		printf("%s ", argv[m]);
-	printf("\n");*/
-
-	optind = 0; /* What a nice undocumented precondition */
+	optind = 0;
 	opterr = 0;
 
 	rrd_update(5, argv);
 }
 
+static void add_ds(struct rrd_update *ru, struct attr *a, const char *dir)
+{
+	char ds[128];
+
+	/* create, file, --start, now, --step, step, DS..., RRA... */
+	if (6 + ru->ru_nds + c_rra_index >= 255)
+		quit("Argument overflow, blame the RRD API\n");
+
+	snprintf(ds, sizeof(ds), "DS:%s_%s:%s:%s:U:U",
+		a->a_def->ad_name, dir,
+		a->a_def->ad_type == ATTR_TYPE_COUNTER ?
+			"COUNTER" : "GAUGE",
+		c_heartbeat);
+
+	ru->ru_ds[ru->ru_nds++] = strdup(ds);
+
+	if (ru->ru_template[0])
+		strncat(ru->ru_template, ":",
+		    sizeof(ru->ru_template) - strlen(ru->ru_template) - 1);
+	strncat(ru->ru_template, a->a_def->ad_name,
+	    sizeof(ru->ru_template) - strlen(ru->ru_template) - 1);
+	strncat(ru->ru_template, "_",
+	    sizeof(ru->ru_template) - strlen(ru->ru_template) - 1);
+	strncat(ru->ru_template, dir,
+	    sizeof(ru->ru_template) - strlen(ru->ru_template) - 1);
+}
+
 static void rrd_draw_element(struct element_group *g, struct element *e,
 			     void *arg)
 {
-	char file[FILENAME_MAX];
+	struct rrd_update *ru;
+	struct attr *a;
+	timestamp_t now;
+
+	ru = xcalloc(1, sizeof(*ru));
 
 	if (c_always_unique)
-		snprintf(file, sizeof(file), "%s/%d_%s.rrd",
+		snprintf(ru->ru_file, sizeof(ru->ru_file), "%s/%d_%s.rrd",
 			 c_path, e->e_id, e->e_name);
 	else
-		snprintf(file, sizeof(file), "%s/%s.rrd",
+		snprintf(ru->ru_file, sizeof(ru->ru_file), "%s/%s.rrd",
 			 c_path, e->e_name);
 
-	if (access(file, W_OK) != 0)
-		create_rrd(file, e);
+	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
+		add_ds(ru, a, "rx");
+		add_ds(ru, a, "tx");
+	}
+
+	wall_timestamp(&now);
+	snprintf(ru->ru_data, sizeof(ru->ru_data), "%" PRId64,
+		 (int64_t) now.tv_sec);
+
+	list_for_each_entry(a, &e->e_attr_sorted, a_sort_list) {
+		char valuepair[64];
+
+		snprintf(valuepair, sizeof(valuepair),
+		    ":%" PRId64 ":%" PRId64,
+		    	a->a_rx_rate.r_total,
+		    	a->a_tx_rate.r_total);
+
+		strncat(ru->ru_data, valuepair,
+		    sizeof(ru->ru_data) - strlen(ru->ru_data) - 1);
+	}
 
-	if (access(file, W_OK) == 0)
-		update_rrd(file, e);
+	list_add_tail(&ru->ru_list, &frame);
 }
 
 void rrd_draw(void)
@@ -201,6 +182,26 @@ void rrd_draw(void)
 	group_foreach_recursive(rrd_draw_element, NULL);
 }
 
+static void rrd_flush(void)
+{
+	struct rrd_update *ru, *n;
+	int i;
+
+	list_for_each_entry_safe(ru, n, &frame, ru_list) {
+		if (access(ru->ru_file, W_OK) != 0)
+			create_rrd(ru);
+
+		if (access(ru->ru_file, W_OK) == 0)
+			update_rrd(ru);
+
+		for (i = 0; i < ru->ru_nds; i++)
+			free(ru->ru_ds[i]);
+
+		list_del(&ru->ru_list);
+		xfree(ru);
+	}
+}
+
 static void rrd_do_init(void)
 {
 	if (!c_rra_index)
@@ -255,6 +256,7 @@ static struct bmon_module rrd_ops = {
 	.m_name		= "rrd",
 	.m_type		= BMON_SECONDARY_MODULE,
 	.m_do		= rrd_draw,
+	.m_flush	= rrd_flush,
 	.m_parse_opt	= rrd_parse_opt,
 	.m_probe	= rrd_probe,
 	.m_init		= rrd_do_init,
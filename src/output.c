@@ -28,10 +28,48 @@
 #include <bmon/conf.h>
 #include <bmon/signal.h>
 #include <bmon/group.h>
+#include <bmon/attr.h>
 #include <bmon/utils.h>
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+
 static struct bmon_subsys output_subsys;
 
+/*
+ * Output modules providing m_flush() split drawing into rendering a
+ * frame from the element tree, m_do(), and writing the frame out,
+ * m_flush(), e.g. the terminal update of curses. The main thread owns
+ * the element tree and renders, each of these modules gets a thread of
+ * its own to write out frames so a slow terminal or disk never delays
+ * the next read.
+ *
+ * A frame is handed over by bumping the frame version of the module
+ * and remains untouched until the output thread has caught up with
+ * that version. The read cycle never waits for it, a frame due while
+ * the previous one is still being written out is dropped.
+ */
+#ifdef HAVE_PTHREAD
+struct output_thread
+{
+	struct bmon_module *	ot_module;
+	pthread_t		ot_thread;
+	sem_t			ot_work;
+	sem_t			ot_done;
+	unsigned int		ot_version;
+	unsigned int		ot_flushed;
+	int			ot_waiting;
+	int			ot_stop;
+	struct list_head	ot_list;
+};
+
+static LIST_HEAD(thread_list);
+#endif
+
+static unsigned long dropped;
+
 void output_register(struct bmon_module *m)
 {
 	module_register(&output_subsys, m);
@@ -53,6 +91,30 @@ static struct bmon_module *output_get(const char *name)
 	return module_lookup(name, &output_subsys.s_primary_list);
 }
 
+static int consumes_all(struct bmon_module *m)
+{
+	return !(m->m_flags & BMON_MODULE_DEMAND);
+}
+
+/*
+ * Returns true if any active output module consumes all attributes.
+ * Output modules flagged BMON_MODULE_DEMAND declare the attributes
+ * they consume with attr_demand() instead.
+ */
+static int output_consumes_all(void)
+{
+	struct bmon_module *m;
+
+	if (consumes_all(output_subsys.s_primary))
+		return 1;
+
+	list_for_each_entry(m, &output_subsys.s_secondary_list, m_list)
+		if (m->m_flags & BMON_MODULE_ENABLED && consumes_all(m))
+			return 1;
+
+	return 0;
+}
+
 static void find_primary(void)
 {
 	if (!output_subsys.s_primary)
@@ -63,11 +125,146 @@ static void find_primary(void)
 
 	if (!output_subsys.s_primary)
 		quit("No output module found.\n");
+
+	if (!output_consumes_all())
+		attr_demand_restrict();
+}
+
+static void output_foreach(void (*cb)(struct bmon_module *))
+{
+	struct bmon_module *m;
+
+	if (output_subsys.s_primary)
+		cb(output_subsys.s_primary);
+
+	list_for_each_entry(m, &output_subsys.s_secondary_list, m_list)
+		if (m->m_flags & BMON_MODULE_ENABLED)
+			cb(m);
+}
+
+#ifdef HAVE_PTHREAD
+static struct output_thread *thread_lookup(struct bmon_module *m)
+{
+	struct output_thread *ot;
+
+	list_for_each_entry(ot, &thread_list, ot_list)
+		if (ot->ot_module == m)
+			return ot;
+
+	return NULL;
+}
+
+static int thread_idle(struct output_thread *ot)
+{
+	return __atomic_load_n(&ot->ot_flushed, __ATOMIC_SEQ_CST) ==
+		ot->ot_version;
+}
+
+/*
+ * Wait for the output thread to write out the last frame. Only used
+ * before handling user input, the read cycle never waits.
+ */
+static void thread_wait(struct output_thread *ot)
+{
+	__atomic_store_n(&ot->ot_waiting, 1, __ATOMIC_SEQ_CST);
+
+	while (!thread_idle(ot))
+		while (sem_wait(&ot->ot_done) < 0 && errno == EINTR);
+
+	__atomic_store_n(&ot->ot_waiting, 0, __ATOMIC_SEQ_CST);
+}
+
+static void *thread_run(void *arg)
+{
+	struct output_thread *ot = arg;
+	unsigned int version;
+
+	for (;;) {
+		while (sem_wait(&ot->ot_work) < 0 && errno == EINTR);
+
+		version = __atomic_load_n(&ot->ot_version, __ATOMIC_SEQ_CST);
+
+		if (version != ot->ot_flushed) {
+			ot->ot_module->m_flush();
+
+			__atomic_store_n(&ot->ot_flushed, version,
+					 __ATOMIC_SEQ_CST);
+
+			if (__atomic_load_n(&ot->ot_waiting, __ATOMIC_SEQ_CST))
+				sem_post(&ot->ot_done);
+		}
+
+		/* frames handed over before the stop are written out */
+		if (__atomic_load_n(&ot->ot_stop, __ATOMIC_SEQ_CST))
+			break;
+	}
+
+	return NULL;
+}
+#endif
+
+static void output_publish(struct bmon_module *m)
+{
+#ifdef HAVE_PTHREAD
+	struct output_thread *ot;
+
+	if ((ot = thread_lookup(m))) {
+		__atomic_store_n(&ot->ot_version, ot->ot_version + 1,
+				 __ATOMIC_SEQ_CST);
+		sem_post(&ot->ot_work);
+		return;
+	}
+#endif
+
+	m->m_flush();
+}
+
+static void pre_one(struct bmon_module *m)
+{
+	if (!m->m_pre)
+		return;
+
+#ifdef HAVE_PTHREAD
+	{
+		struct output_thread *ot;
+
+		/* m_pre() may redraw, the previous frame must be out */
+		if ((ot = thread_lookup(m)))
+			thread_wait(ot);
+	}
+#endif
+
+	m->m_pre();
+}
+
+static void draw_one(struct bmon_module *m)
+{
+	if (!m->m_do)
+		return;
+
+	if (!m->m_flush) {
+		m->m_do();
+		return;
+	}
+
+#ifdef HAVE_PTHREAD
+	{
+		struct output_thread *ot;
+
+		if ((ot = thread_lookup(m)) && !thread_idle(ot)) {
+			dropped++;
+			return;
+		}
+	}
+#endif
+
+	m->m_do();
+	output_publish(m);
 }
 
 void output_pre(void)
 {
-	FOR_ALL_OUTPUT(pre);
+	output_foreach(pre_one);
 }
 					
 void output_draw(void)
@@ -82,7 +279,30 @@ void output_draw(void)
 	if (signal_driven && !signal_received())
 		return;
 
-	FOR_ALL_OUTPUT(do);
+	output_foreach(draw_one);
+}
+
+/**
+ * Render and write out a frame outside of the read cycle
+ * @arg m		Output module
+ *
+ * To be called from m_pre(), e.g. to react to user input.
+ */
+void output_redraw(struct bmon_module *m)
+{
+	m->m_do();
+
+	if (m->m_flush)
+		output_publish(m);
+}
+
+/**
+ * Returns the number of frames dropped because an output thread was
+ * still busy writing out the previous frame.
+ */
+unsigned long output_dropped(void)
+{
+	return dropped;
 }
 
 void output_post(void)
@@ -90,6 +310,140 @@ void output_post(void)
 	FOR_ALL_OUTPUT(post);
 }
 
+static int is_interactive(struct bmon_module *m)
+{
+	return m->m_flags & BMON_MODULE_INTERACTIVE;
+}
+
+/**
+ * Returns true if any active output module consumes user input
+ */
+int output_is_interactive(void)
+{
+	struct bmon_module *m;
+
+	if (output_subsys.s_primary && is_interactive(output_subsys.s_primary))
+		return 1;
+
+	list_for_each_entry(m, &output_subsys.s_secondary_list, m_list)
+		if (m->m_flags & BMON_MODULE_ENABLED && is_interactive(m))
+			return 1;
+
+	return 0;
+}
+
+static void start_one(struct bmon_module *m)
+{
+#ifdef HAVE_PTHREAD
+	struct output_thread *ot;
+	sigset_t all, old;
+	int err;
+
+	if (!m->m_flush)
+		return;
+
+	ot = xcalloc(1, sizeof(*ot));
+	ot->ot_module = m;
+	sem_init(&ot->ot_work, 0, 0);
+	sem_init(&ot->ot_done, 0, 0);
+
+	/* signals are handled by the main thread */
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+	err = pthread_create(&ot->ot_thread, NULL, thread_run, ot);
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+	if (err) {
+		xwarn("Unable to start %s output thread: %s\n",
+		      m->m_name, strerror(err));
+		sem_destroy(&ot->ot_work);
+		sem_destroy(&ot->ot_done);
+		xfree(ot);
+		return;
+	}
+
+	list_add_tail(&ot->ot_list, &thread_list);
+#endif
+}
+
+/**
+ * Start output threads
+ *
+ * Must be called after daemonizing. Output modules without a thread
+ * write out their frames right away.
+ */
+void output_start(void)
+{
+	if (cfg_getbool(cfg, "output_threads"))
+		output_foreach(start_one);
+}
+
+/**
+ * Stop output threads
+ *
+ * Waits for the frames handed over to be written out.
+ */
+void output_stop(void)
+{
+#ifdef HAVE_PTHREAD
+	struct output_thread *ot, *n;
+
+	list_for_each_entry_safe(ot, n, &thread_list, ot_list) {
+		list_del(&ot->ot_list);
+
+		if (pthread_equal(ot->ot_thread, pthread_self()))
+			continue;
+
+		__atomic_store_n(&ot->ot_stop, 1, __ATOMIC_SEQ_CST);
+		sem_post(&ot->ot_work);
+		pthread_join(ot->ot_thread, NULL);
+
+		sem_destroy(&ot->ot_work);
+		sem_destroy(&ot->ot_done);
+		xfree(ot);
+	}
+#endif
+}
+
+/**
+ * Open frame buffer
+ * @arg ob		Output buffer
+ *
+ * Returns a stream for m_do() to print the frame to.
+ */
+FILE *output_buffer_open(struct output_buffer *ob)
+{
+	if (!(ob->ob_file = open_memstream(&ob->ob_data, &ob->ob_len)))
+		quit("Unable to open output buffer: %s\n", strerror(errno));
+
+	return ob->ob_file;
+}
+
+void output_buffer_close(struct output_buffer *ob)
+{
+	if (ob->ob_file) {
+		fclose(ob->ob_file);
+		ob->ob_file = NULL;
+	}
+}
+
+/**
+ * Write out frame buffer
+ * @arg ob		Output buffer, closed
+ * @arg fd		Stream to write the frame to
+ */
+void output_buffer_write(struct output_buffer *ob, FILE *fd)
+{
+	if (ob->ob_len)
+		fwrite(ob->ob_data, 1, ob->ob_len, fd);
+
+	fflush(fd);
+
+	free(ob->ob_data);
+	ob->ob_data = NULL;
+	ob->ob_len = 0;
+}
+
 void output_set(const char *name)
 {
 	return module_set(&output_subsys, BMON_PRIMARY_MODULE, name);
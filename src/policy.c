@@ -0,0 +1,423 @@
+/*
+ * policy.c             Element Policy
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/element_cfg.h>
+#include <bmon/policy.h>
+#include <bmon/utils.h>
+
+/*
+ * The policy rules and the names of the element configurations are
+ * compiled into a single case insensitive trie. Exact rules and
+ * configurations are attached to the node their name ends in, prefix
+ * rules ("eth*") to the node the prefix ends in. A single walk along
+ * the name thus yields all exact and prefix rules matching and the
+ * element configuration. All other glob rules are matched separately.
+ *
+ * Decisions are cached per name as elements tend to come and go under
+ * the same name.
+ */
+
+#define POLICY_DENY		0x01
+#define POLICY_ALLOW		0x02
+#define POLICY_DENY_PREFIX	0x04
+#define POLICY_ALLOW_PREFIX	0x08
+
+struct policy
+{
+	char *			p_rule;
+	int			p_deny;
+	struct list_head	p_list;
+	struct list_head	p_glob_list;
+};
+
+struct policy_node
+{
+	char			pn_char;
+	int			pn_flags;
+	struct element_cfg *	pn_cfg;
+	struct policy_node *	pn_child;
+	struct policy_node *	pn_next;
+};
+
+struct policy_cache
+{
+	char *			pc_name;
+	int			pc_allowed;
+	struct element_cfg *	pc_cfg;
+	struct list_head	pc_list;
+};
+
+#define CACHE_HASH_SIZE		256
+#define CACHE_MAX		4096
+
+static LIST_HEAD(rules);
+static LIST_HEAD(deny_globs);
+static LIST_HEAD(allow_globs);
+static int have_allow;
+
+static struct policy_node *root;
+static int compiled;
+
+static struct list_head cache[CACHE_HASH_SIZE];
+static unsigned int cache_size;
+
+static int match_mask(const struct policy *p, const char *str)
+{
+	int i, n;
+	char c;
+
+	if (!p || !str)
+		return 0;
+	
+	for (i = 0, n = 0; p->p_rule[i] != '\0'; i++) {
+		if (p->p_rule[i] == '*') {
+			c = tolower(p->p_rule[i + 1]);
+			
+			if (c == '\0')
+				return 1;
+			
+			while (tolower(str[n]) != c)
+				if (str[n++] == '\0')
+					return 0;
+		} else if (tolower(p->p_rule[i]) != tolower(str[n++]))
+			return 0;
+	}
+
+	return str[n] == '\0' ? 1 : 0;
+}
+
+static struct policy_node *node_alloc(char c)
+{
+	struct policy_node *n;
+
+	n = xcalloc(1, sizeof(*n));
+	n->pn_char = c;
+
+	return n;
+}
+
+static void node_free(struct policy_node *n)
+{
+	struct policy_node *c, *next;
+
+	if (!n)
+		return;
+
+	for (c = n->pn_child; c; c = next) {
+		next = c->pn_next;
+		node_free(c);
+	}
+
+	xfree(n);
+}
+
+static struct policy_node *node_child(struct policy_node *n, char c)
+{
+	for (n = n->pn_child; n; n = n->pn_next)
+		if (n->pn_char == c)
+			return n;
+
+	return NULL;
+}
+
+/* returns the node for the first len characters of name, creating it */
+static struct policy_node *node_insert(const char *name, size_t len)
+{
+	struct policy_node *n = root, *c;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		char ch = tolower(name[i]);
+
+		if (!(c = node_child(n, ch))) {
+			c = node_alloc(ch);
+			c->pn_next = n->pn_child;
+			n->pn_child = c;
+		}
+
+		n = c;
+	}
+
+	return n;
+}
+
+static void compile_rule(struct policy *p)
+{
+	char *star = strchr(p->p_rule, '*');
+	size_t len = strlen(p->p_rule);
+
+	if (!star)
+		node_insert(p->p_rule, len)->pn_flags |=
+			p->p_deny ? POLICY_DENY : POLICY_ALLOW;
+	else if (star == p->p_rule + len - 1)
+		node_insert(p->p_rule, len - 1)->pn_flags |=
+			p->p_deny ? POLICY_DENY_PREFIX : POLICY_ALLOW_PREFIX;
+	else
+		list_add_tail(&p->p_glob_list, p->p_deny ? &deny_globs
+							 : &allow_globs);
+}
+
+static void compile_cfg(struct element_cfg *ec, void *arg)
+{
+	struct policy_node *n = node_insert(ec->ec_name, strlen(ec->ec_name));
+
+	/* first configuration wins, like a linear search would */
+	if (!n->pn_cfg)
+		n->pn_cfg = ec;
+}
+
+static void cache_flush(void)
+{
+	struct policy_cache *pc, *n;
+	int i;
+
+	for (i = 0; i < CACHE_HASH_SIZE; i++) {
+		list_for_each_entry_safe(pc, n, &cache[i], pc_list) {
+			list_del(&pc->pc_list);
+			xfree(pc->pc_name);
+			xfree(pc);
+		}
+	}
+
+	cache_size = 0;
+}
+
+static void compile(void)
+{
+	struct policy *p;
+
+	init_list_head(&deny_globs);
+	init_list_head(&allow_globs);
+
+	node_free(root);
+	root = node_alloc('\0');
+	have_allow = 0;
+
+	list_for_each_entry(p, &rules, p_list) {
+		if (!p->p_deny)
+			have_allow = 1;
+
+		compile_rule(p);
+	}
+
+	element_cfg_foreach(compile_cfg, NULL);
+
+	cache_flush();
+	compiled = 1;
+}
+
+static int match_globs(struct list_head *list, const char *name)
+{
+	struct policy *p;
+
+	list_for_each_entry(p, list, p_glob_list)
+		if (match_mask(p, name))
+			return 1;
+
+	return 0;
+}
+
+static int decide(const char *name, struct element_cfg **cfg)
+{
+	struct policy_node *n = root;
+	int flags = root->pn_flags & (POLICY_DENY_PREFIX | POLICY_ALLOW_PREFIX);
+	const char *s;
+
+	*cfg = NULL;
+
+	for (s = name; *s && n; s++) {
+		if ((n = node_child(n, tolower(*s))))
+			flags |= n->pn_flags &
+				 (POLICY_DENY_PREFIX | POLICY_ALLOW_PREFIX);
+	}
+
+	if (n) {
+		flags |= n->pn_flags & (POLICY_DENY | POLICY_ALLOW);
+
+		/* the trie is case insensitive, configurations are not */
+		if (n->pn_cfg && !strcmp(n->pn_cfg->ec_name, name))
+			*cfg = n->pn_cfg;
+		else if (n->pn_cfg)
+			*cfg = element_cfg_lookup(name);
+	}
+
+	if (*cfg) {
+		if ((*cfg)->ec_flags & ELEMENT_CFG_HIDE)
+			return 0;
+		else if ((*cfg)->ec_flags & ELEMENT_CFG_SHOW)
+			return 1;
+	}
+
+	if (flags & (POLICY_DENY | POLICY_DENY_PREFIX) ||
+	    match_globs(&deny_globs, name))
+		return 0;
+
+	if (have_allow)
+		return (flags & (POLICY_ALLOW | POLICY_ALLOW_PREFIX)) ||
+		       match_globs(&allow_globs, name);
+
+	return 1;
+}
+
+static unsigned int cache_hash(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char) *name++) * 16777619u;
+
+	return hash % CACHE_HASH_SIZE;
+}
+
+/**
+ * Look up policy decision and configuration of an element
+ * @arg name		name of element
+ * @arg cfg		returns element configuration or NULL
+ *
+ * @return True if the element may be shown.
+ */
+int policy_lookup(const char *name, struct element_cfg **cfg)
+{
+	struct list_head *head;
+	struct policy_cache *pc;
+
+	if (!compiled)
+		compile();
+
+	head = &cache[cache_hash(name)];
+
+	list_for_each_entry(pc, head, pc_list) {
+		if (!strcmp(pc->pc_name, name)) {
+			*cfg = pc->pc_cfg;
+			return pc->pc_allowed;
+		}
+	}
+
+	/* names of vanished elements pile up, start over if too many */
+	if (cache_size >= CACHE_MAX)
+		cache_flush();
+
+	pc = xcalloc(1, sizeof(*pc));
+	pc->pc_name = strdup(name);
+	pc->pc_allowed = decide(name, &pc->pc_cfg);
+	list_add_tail(&pc->pc_list, head);
+	cache_size++;
+
+	*cfg = pc->pc_cfg;
+
+	return pc->pc_allowed;
+}
+
+/**
+ * Recompile policy on next lookup
+ *
+ * Must be called whenever element configurations are added or removed.
+ */
+void policy_invalidate(void)
+{
+	compiled = 0;
+}
+
+/**
+ * Add element configuration to compiled policy
+ * @arg ec		new element configuration
+ *
+ * Elements such as HTB classes create their configuration at runtime,
+ * the configuration is added to the trie without recompiling.
+ */
+void policy_add_cfg(struct element_cfg *ec)
+{
+	struct list_head *head;
+	struct policy_cache *pc;
+
+	if (!compiled)
+		return;
+
+	compile_cfg(ec, NULL);
+
+	head = &cache[cache_hash(ec->ec_name)];
+
+	list_for_each_entry(pc, head, pc_list) {
+		if (!strcmp(pc->pc_name, ec->ec_name)) {
+			pc->pc_allowed = decide(pc->pc_name, &pc->pc_cfg);
+			break;
+		}
+	}
+}
+
+/**
+ * Parse policy string
+ * @arg policy		comma separated list of [!]rule
+ */
+void policy_parse(const char *policy)
+{
+	char *start, *copy, *save = NULL, *tok;
+	struct policy *p;
+
+	if (!policy)
+		return;
+
+	copy = strdup(policy);
+	start = copy;
+
+	while ((tok = strtok_r(start, ",", &save)) != NULL) {
+		start = NULL;
+
+		p = xcalloc(1, sizeof(*p));
+
+		if (*tok == '!') {
+			p->p_deny = 1;
+			tok++;
+		}
+
+		p->p_rule = strdup(tok);
+		list_add_tail(&p->p_list, &rules);
+	}
+	
+	xfree(copy);
+
+	policy_invalidate();
+}
+
+static void __init policy_init(void)
+{
+	int i;
+
+	for (i = 0; i < CACHE_HASH_SIZE; i++)
+		init_list_head(&cache[i]);
+}
+
+static void __exit policy_exit(void)
+{
+	struct policy *p, *n;
+
+	cache_flush();
+	node_free(root);
+
+	list_for_each_entry_safe(p, n, &rules, p_list) {
+		xfree(p->p_rule);
+		xfree(p);
+	}
+}
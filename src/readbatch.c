@@ -0,0 +1,369 @@
+/*
+ * readbatch.c          Batched File Reads
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/readbatch.h>
+#include <bmon/utils.h>
+
+#if defined HAVE_LINUX_IO_URING_H
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined HAVE_LINUX_IO_URING_H && defined __NR_io_uring_setup
+#define HAVE_URING
+
+#define URING_ENTRIES	512
+
+struct uring {
+	int			u_fd;
+	int			u_verified;
+
+	unsigned int *		u_sq_head;
+	unsigned int *		u_sq_tail;
+	unsigned int *		u_sq_mask;
+	unsigned int *		u_sq_array;
+	unsigned int		u_sq_entries;
+	struct io_uring_sqe *	u_sqes;
+
+	unsigned int *		u_cq_head;
+	unsigned int *		u_cq_tail;
+	unsigned int *		u_cq_mask;
+	struct io_uring_cqe *	u_cqes;
+
+	void *			u_sq_ptr;
+	void *			u_cq_ptr;
+	size_t			u_sq_len;
+	size_t			u_cq_len;
+	size_t			u_sqes_len;
+};
+
+static void uring_free(struct uring *u)
+{
+	if (u->u_sqes)
+		munmap(u->u_sqes, u->u_sqes_len);
+	if (u->u_cq_ptr && u->u_cq_ptr != u->u_sq_ptr)
+		munmap(u->u_cq_ptr, u->u_cq_len);
+	if (u->u_sq_ptr)
+		munmap(u->u_sq_ptr, u->u_sq_len);
+
+	close(u->u_fd);
+	xfree(u);
+}
+
+static struct uring *uring_alloc(void)
+{
+	struct io_uring_params p;
+	struct uring *u;
+	char *sq, *cq;
+	int fd;
+
+	memset(&p, 0, sizeof(p));
+
+	/* fails with ENOSYS on old kernels and EPERM in many sandboxes */
+	if ((fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p)) < 0)
+		return NULL;
+
+	u = xcalloc(1, sizeof(*u));
+	u->u_fd = fd;
+
+	u->u_sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	u->u_cq_len = p.cq_off.cqes +
+		      p.cq_entries * sizeof(struct io_uring_cqe);
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (u->u_cq_len > u->u_sq_len)
+			u->u_sq_len = u->u_cq_len;
+		u->u_cq_len = u->u_sq_len;
+	}
+
+	u->u_sq_ptr = mmap(NULL, u->u_sq_len, PROT_READ | PROT_WRITE,
+			   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (u->u_sq_ptr == MAP_FAILED) {
+		u->u_sq_ptr = NULL;
+		goto errout;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		u->u_cq_ptr = u->u_sq_ptr;
+	else {
+		u->u_cq_ptr = mmap(NULL, u->u_cq_len, PROT_READ | PROT_WRITE,
+				   MAP_SHARED | MAP_POPULATE, fd,
+				   IORING_OFF_CQ_RING);
+		if (u->u_cq_ptr == MAP_FAILED) {
+			u->u_cq_ptr = NULL;
+			goto errout;
+		}
+	}
+
+	u->u_sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	u->u_sqes = mmap(NULL, u->u_sqes_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (u->u_sqes == MAP_FAILED) {
+		u->u_sqes = NULL;
+		goto errout;
+	}
+
+	sq = u->u_sq_ptr;
+	u->u_sq_head = (unsigned int *) (sq + p.sq_off.head);
+	u->u_sq_tail = (unsigned int *) (sq + p.sq_off.tail);
+	u->u_sq_mask = (unsigned int *) (sq + p.sq_off.ring_mask);
+	u->u_sq_array = (unsigned int *) (sq + p.sq_off.array);
+	u->u_sq_entries = p.sq_entries;
+
+	cq = u->u_cq_ptr;
+	u->u_cq_head = (unsigned int *) (cq + p.cq_off.head);
+	u->u_cq_tail = (unsigned int *) (cq + p.cq_off.tail);
+	u->u_cq_mask = (unsigned int *) (cq + p.cq_off.ring_mask);
+	u->u_cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+	return u;
+
+errout:
+	uring_free(u);
+	return NULL;
+}
+
+static unsigned int uring_reap(struct uring *u, struct read_batch *rb)
+{
+	unsigned int head, tail, n = 0;
+
+	head = *u->u_cq_head;
+	tail = __atomic_load_n(u->u_cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = &u->u_cqes[head & *u->u_cq_mask];
+
+		rb->rb_reqs[cqe->user_data].rr_res = cqe->res;
+		head++;
+		n++;
+	}
+
+	__atomic_store_n(u->u_cq_head, head, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/*
+ * Queues requests [first, first + n) and waits for all of them to
+ * complete. Returns 0 on success or -1 if the ring became unusable.
+ */
+static int uring_submit(struct uring *u, struct read_batch *rb,
+			unsigned int first, unsigned int n)
+{
+	unsigned int i, tail, done = 0;
+
+	tail = *u->u_sq_tail;
+
+	for (i = first; i < first + n; i++) {
+		struct read_req *req = &rb->rb_reqs[i];
+		unsigned int idx = tail & *u->u_sq_mask;
+		struct io_uring_sqe *sqe = &u->u_sqes[idx];
+
+		memset(sqe, 0, sizeof(*sqe));
+		sqe->opcode = IORING_OP_READ;
+		sqe->fd = req->rr_fd;
+		sqe->addr = (unsigned long) req->rr_buf;
+		sqe->len = req->rr_len;
+		sqe->off = 0;
+		sqe->user_data = i;
+
+		u->u_sq_array[idx] = idx;
+		tail++;
+	}
+
+	__atomic_store_n(u->u_sq_tail, tail, __ATOMIC_RELEASE);
+
+	while (done < n) {
+		unsigned int pending;
+
+		if ((done += uring_reap(u, rb)) >= n)
+			break;
+
+		pending = tail - __atomic_load_n(u->u_sq_head, __ATOMIC_ACQUIRE);
+
+		rb->rb_syscalls++;
+		if (syscall(__NR_io_uring_enter, u->u_fd, pending, n - done,
+			    IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+		    errno != EINTR && errno != EAGAIN && errno != EBUSY)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int uring_submit_all(struct uring *u, struct read_batch *rb)
+{
+	unsigned int first, n;
+
+	for (first = 0; first < rb->rb_nreqs; first += n) {
+		n = rb->rb_nreqs - first;
+		if (n > u->u_sq_entries)
+			n = u->u_sq_entries;
+
+		if (uring_submit(u, rb, first, n) < 0)
+			return -1;
+
+		/*
+		 * IORING_OP_READ appeared after io_uring itself, older
+		 * kernels reject it with EINVAL.
+		 */
+		if (!u->u_verified) {
+			if (rb->rb_reqs[first].rr_res == -EINVAL)
+				return -1;
+			u->u_verified = 1;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+static void pread_submit_all(struct read_batch *rb)
+{
+	unsigned int i;
+
+	for (i = 0; i < rb->rb_nreqs; i++) {
+		struct read_req *req = &rb->rb_reqs[i];
+
+		rb->rb_syscalls++;
+		if ((req->rr_res = pread(req->rr_fd, req->rr_buf,
+					 req->rr_len, 0)) < 0)
+			req->rr_res = -errno;
+	}
+}
+
+static void fallback_to_pread(struct read_batch *rb)
+{
+#if defined HAVE_URING
+	if (rb->rb_ring)
+		uring_free(rb->rb_ring);
+#endif
+	rb->rb_ring = NULL;
+	rb->rb_backend = READ_BACKEND_PREAD;
+}
+
+int read_backend_lookup(const char *name)
+{
+	if (!strcasecmp(name, "pread"))
+		return READ_BACKEND_PREAD;
+	else if (!strcasecmp(name, "uring") || !strcasecmp(name, "io_uring"))
+		return READ_BACKEND_URING;
+
+	return -1;
+}
+
+const char *read_backend_name(int backend)
+{
+	switch (backend) {
+	case READ_BACKEND_URING:
+		return "io_uring";
+	default:
+		return "pread";
+	}
+}
+
+/**
+ * Initialize a read batch
+ * @arg rb		read batch
+ * @arg backend		preferred backend (READ_BACKEND_*)
+ *
+ * Falls back to pread() if the preferred backend is not available,
+ * rb->rb_backend reflects the backend actually in use.
+ */
+void read_batch_init(struct read_batch *rb, int backend)
+{
+	memset(rb, 0, sizeof(*rb));
+	rb->rb_backend = READ_BACKEND_PREAD;
+
+#if defined HAVE_URING
+	if (backend == READ_BACKEND_URING &&
+	    (rb->rb_ring = uring_alloc()))
+		rb->rb_backend = READ_BACKEND_URING;
+#endif
+}
+
+void read_batch_exit(struct read_batch *rb)
+{
+	fallback_to_pread(rb);
+	xfree(rb->rb_reqs);
+	rb->rb_reqs = NULL;
+	rb->rb_size = rb->rb_nreqs = 0;
+}
+
+/**
+ * Queue a read request
+ * @arg rb		read batch
+ * @arg fd		file descriptor, read from offset 0
+ * @arg buf		destination buffer
+ * @arg len		size of destination buffer
+ *
+ * The buffer must remain valid until read_batch_submit() returns.
+ *
+ * @return Index of request in rb->rb_reqs
+ */
+unsigned int read_batch_add(struct read_batch *rb, int fd, char *buf,
+			    size_t len)
+{
+	struct read_req *req;
+
+	if (rb->rb_nreqs >= rb->rb_size) {
+		rb->rb_size = rb->rb_size ? rb->rb_size * 2 : 64;
+		rb->rb_reqs = xrealloc(rb->rb_reqs,
+				       rb->rb_size * sizeof(*req));
+	}
+
+	req = &rb->rb_reqs[rb->rb_nreqs];
+	req->rr_fd = fd;
+	req->rr_buf = buf;
+	req->rr_len = len;
+	req->rr_res = 0;
+
+	return rb->rb_nreqs++;
+}
+
+/**
+ * Perform all queued reads
+ * @arg rb		read batch
+ *
+ * On return, rr_res of every request holds the number of bytes read or
+ * a negative errno.
+ */
+void read_batch_submit(struct read_batch *rb)
+{
+	if (!rb->rb_nreqs)
+		return;
+
+#if defined HAVE_URING
+	if (rb->rb_ring) {
+		if (uring_submit_all(rb->rb_ring, rb) == 0)
+			return;
+
+		fallback_to_pread(rb);
+	}
+#endif
+
+	pread_submit_all(rb);
+}
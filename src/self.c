@@ -0,0 +1,146 @@
+/*
+ * self.c               Self Instrumentation
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/conf.h>
+#include <bmon/self.h>
+#include <bmon/group.h>
+#include <bmon/input.h>
+#include <bmon/element.h>
+#include <bmon/attr.h>
+#include <bmon/history.h>
+#include <bmon/output.h>
+#include <bmon/unit.h>
+#include <bmon/utils.h>
+
+#define SELF_GROUP	"bmon"
+
+static struct {
+	const char *	name;
+	const char *	unit;
+	const char *	description;
+	int		attrid;
+} self_attrs[__SELF_MAX] = {
+	[SELF_READ]	= { "read_time",	"nsec", "Input Time" },
+	[SELF_EXPIRE]	= { "expire_time",	"nsec", "Expire Time" },
+	[SELF_DRAW]	= { "draw_time",	"nsec", "Output Time" },
+	[SELF_TICK]	= { "tick_time",	"nsec", "Read Cycle Time" },
+	[SELF_LATENESS]	= { "read_late",	"nsec", "Read Lateness" },
+	[SELF_HISTORY_USED]  = { "history_used",	"byte", "History Used" },
+	[SELF_HISTORY_ARENA] = { "history_arena",	"byte", "History Arena" },
+	[SELF_DROPPED]	= { "frames_dropped",	"number", "Dropped Frames" },
+};
+
+static uint64_t samples[__SELF_MAX];
+static struct element_group *grp;
+static int enabled = -1;
+
+/**
+ * Return monotonic time in nanoseconds
+ */
+uint64_t self_clock(void)
+{
+	return clock_ns();
+}
+
+void self_record(int phase, uint64_t ns)
+{
+	samples[phase] = ns;
+}
+
+void self_record_timestamp(int phase, timestamp_t *ts)
+{
+	if (timestamp_is_negative(ts))
+		samples[phase] = 0;
+	else
+		samples[phase] = (uint64_t) ts->tv_sec * 1000000000ULL +
+				 ts->tv_usec * 1000ULL;
+}
+
+static int self_init(void)
+{
+	struct unit *u;
+	int i;
+
+	if (!cfg_getbool(cfg, "self_stats"))
+		return 0;
+
+	for (i = 0; i < __SELF_MAX; i++) {
+		if (!(u = unit_lookup(self_attrs[i].unit)))
+			BUG();
+
+		self_attrs[i].attrid = attr_def_add(self_attrs[i].name,
+						    self_attrs[i].description,
+						    u, ATTR_TYPE_RATE,
+						    ATTR_DEF_FLAG_HISTORY);
+	}
+
+	group_new_hdr(SELF_GROUP, "bmon", "Input", "Output", "", "");
+
+	if (!(grp = group_lookup(SELF_GROUP, GROUP_CREATE)))
+		BUG();
+
+	return 1;
+}
+
+/**
+ * Publish the samples recorded during the previous read cycle
+ *
+ * Called at the start of every read cycle so the values are marked as
+ * updated when the outputs draw. The timings of a cycle therefore
+ * appear one cycle late.
+ */
+void self_publish(void)
+{
+	struct history_usage usage;
+	struct element *e;
+	int i;
+
+	if (enabled < 0)
+		enabled = self_init();
+
+	if (!enabled)
+		return;
+
+	if (!(e = element_lookup(grp, "bmon", 0, NULL)))
+		return;
+
+	if (e->e_flags & ELEMENT_FLAG_CREATED) {
+		element_set_key_attr(e, self_attrs[SELF_READ].attrid,
+				     self_attrs[SELF_DRAW].attrid);
+		e->e_flags &= ~ELEMENT_FLAG_CREATED;
+	}
+
+	history_usage(&usage);
+	self_record(SELF_HISTORY_USED, usage.hu_used);
+	self_record(SELF_HISTORY_ARENA, usage.hu_reserved);
+	self_record(SELF_DROPPED, output_dropped());
+
+	for (i = 0; i < __SELF_MAX; i++)
+		attr_update(e, self_attrs[i].attrid, samples[i], 0,
+			    UPDATE_FLAG_RX);
+
+	element_notify_update(e, &rtiming.rt_last_read);
+	element_lifesign(e, 1);
+}
@@ -0,0 +1,160 @@
+/*
+ * sketch.c		Quantile Sketch
+ *
+ * Copyright (c) 2001-2013 Thomas Graf <tgraf@suug.ch>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+ * OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+#include <bmon/bmon.h>
+#include <bmon/sketch.h>
+#include <bmon/utils.h>
+
+#define SKETCH_GAMMA	((1.0 + SKETCH_ALPHA) / (1.0 - SKETCH_ALPHA))
+
+static int sketch_index(double v)
+{
+	static double log_gamma;
+
+	if (!log_gamma)
+		log_gamma = log(SKETCH_GAMMA);
+
+	return (int) ceil(log(v) / log_gamma);
+}
+
+/* value within the bucket with the least relative error to all others */
+static double sketch_value(int index)
+{
+	return 2.0 * pow(SKETCH_GAMMA, index) / (SKETCH_GAMMA + 1.0);
+}
+
+/* move the buckets to a new offset, buckets below it are collapsed */
+static void sketch_shift(struct sketch *s, int offset)
+{
+	uint32_t bins[SKETCH_BINS];
+	int i, j;
+
+	memset(bins, 0, sizeof(bins));
+
+	for (i = 0; i < SKETCH_BINS; i++) {
+		if (!s->sk_bins[i])
+			continue;
+
+		j = s->sk_offset + i - offset;
+		if (j < 0)
+			j = 0;
+		else if (j >= SKETCH_BINS)
+			BUG();
+
+		bins[j] += s->sk_bins[i];
+	}
+
+	memcpy(s->sk_bins, bins, sizeof(bins));
+	s->sk_offset = offset;
+}
+
+static void sketch_add_index(struct sketch *s, int index, uint32_t n)
+{
+	int hi;
+
+	if (s->sk_count == s->sk_zero)
+		/* first bucket in use, center the range around it */
+		s->sk_offset = index - SKETCH_BINS / 2;
+	else if (index >= s->sk_offset + SKETCH_BINS)
+		sketch_shift(s, index - SKETCH_BINS + 1);
+	else if (index < s->sk_offset) {
+		for (hi = SKETCH_BINS - 1; hi > 0 && !s->sk_bins[hi]; hi--);
+
+		if (s->sk_offset + hi - index < SKETCH_BINS)
+			sketch_shift(s, index);
+		else
+			index = s->sk_offset;
+	}
+
+	s->sk_bins[index - s->sk_offset] += n;
+	s->sk_count += n;
+}
+
+/**
+ * Add sample to sketch
+ * @arg s		Sketch
+ * @arg v		Sample, negative values are counted as zero
+ */
+void sketch_add(struct sketch *s, double v)
+{
+	if (v <= 0.0 || isnan(v)) {
+		s->sk_zero++;
+		s->sk_count++;
+	} else
+		sketch_add_index(s, sketch_index(v), 1);
+}
+
+/**
+ * Merge sketch into another
+ * @arg dst		Sketch to add samples to
+ * @arg src		Sketch to merge
+ */
+void sketch_merge(struct sketch *dst, const struct sketch *src)
+{
+	int i;
+
+	for (i = 0; i < SKETCH_BINS; i++)
+		if (src->sk_bins[i])
+			sketch_add_index(dst, src->sk_offset + i,
+					 src->sk_bins[i]);
+
+	dst->sk_zero += src->sk_zero;
+	dst->sk_count += src->sk_zero;
+}
+
+/**
+ * Estimate quantile
+ * @arg s		Sketch
+ * @arg q		Quantile, 0.0 to 1.0
+ * @arg v		Estimated value
+ *
+ * @return 0 on success or -1 if the sketch holds no samples.
+ */
+int sketch_quantile(const struct sketch *s, double q, double *v)
+{
+	double rank;
+	uint64_t n;
+	int i;
+
+	if (!s->sk_count)
+		return -1;
+
+	rank = q * (s->sk_count - 1);
+
+	if (rank < s->sk_zero) {
+		*v = 0.0;
+		return 0;
+	}
+
+	n = s->sk_zero;
+	for (i = 0; i < SKETCH_BINS - 1; i++) {
+		n += s->sk_bins[i];
+		if (n > rank)
+			break;
+	}
+
+	*v = sketch_value(s->sk_offset + i);
+
+	return 0;
+}
@@ -208,6 +208,8 @@ char *unit_bit2str(uint64_t bits, char *buf, size_t len)
 
 static void __init unit_init(void)
 {
+	struct unit *u;
+
 	if (!(byte_unit = unit_add("byte")))
 		BUG();
 
@@ -246,6 +248,14 @@ static void __init unit_init(void)
 	unit_add_div(number_unit, UNIT_DEFAULT, "M", 1000000);
 	unit_add_div(number_unit, UNIT_DEFAULT, "G", 1000000000);
 	unit_add_div(number_unit, UNIT_DEFAULT, "T", 1000000000000);
+
+	if (!(u = unit_add("nsec")))
+		BUG();
+
+	unit_add_div(u, UNIT_DEFAULT, "ns", 1.);
+	unit_add_div(u, UNIT_DEFAULT, "us", 1000);
+	unit_add_div(u, UNIT_DEFAULT, "ms", 1000000);
+	unit_add_div(u, UNIT_DEFAULT, "s", 1000000000);
 }
 
 static void __exit unit_exit(void)
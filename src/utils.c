@@ -109,9 +109,94 @@ int timestamp_is_negative(timestamp_t *ts)
 	return (ts->tv_sec < 0 || ts->tv_usec < 0);
 }
 
+/*
+ * Clock source
+ *
+ * All timestamps used for scheduling, rate calculation and history are
+ * taken from the monotonic clock. A simulated clock may be used instead
+ * which only advances when told to, e.g. by a benchmark replaying hours
+ * of reads in a fraction of the time.
+ */
+static int clock_simulated;
+static uint64_t simulated_now, simulated_start;
+static timestamp_t simulated_wall;
+
+static uint64_t real_clock_ns(void)
+{
+#if defined CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+
+	return (uint64_t) tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+}
+
+/**
+ * Return current time of the clock source in nanoseconds
+ */
+uint64_t clock_ns(void)
+{
+	return clock_simulated ? simulated_now : real_clock_ns();
+}
+
+/**
+ * Switch to a simulated clock
+ *
+ * The simulated clock starts at the current time of the real clock and
+ * only advances through clock_advance().
+ */
+void clock_simulate(void)
+{
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	simulated_wall.tv_sec = tv.tv_sec;
+	simulated_wall.tv_usec = tv.tv_usec;
+
+	simulated_now = simulated_start = real_clock_ns();
+	clock_simulated = 1;
+}
+
+void clock_advance(uint64_t ns)
+{
+	if (!clock_simulated)
+		BUG();
+
+	simulated_now += ns;
+}
+
+static void ns_to_timestamp(timestamp_t *dst, uint64_t ns)
+{
+	dst->tv_sec = ns / 1000000000ULL;
+	dst->tv_usec = (ns % 1000000000ULL) / 1000ULL;
+}
+
 void update_timestamp(timestamp_t *dst)
+{
+	ns_to_timestamp(dst, clock_ns());
+}
+
+/**
+ * Return the wall clock time matching the current time of the clock
+ * source, for outputs which need to label samples with absolute time.
+ */
+void wall_timestamp(timestamp_t *dst)
 {
 	struct timeval tv;
+	timestamp_t elapsed;
+
+	if (clock_simulated) {
+		ns_to_timestamp(&elapsed, simulated_now - simulated_start);
+		timestamp_add(dst, &simulated_wall, &elapsed);
+		return;
+	}
 
 	gettimeofday(&tv, NULL);
 
@@ -122,7 +207,7 @@ void update_timestamp(timestamp_t *dst)
 void copy_timestamp(timestamp_t *ts1, timestamp_t *ts2)
 {
 	ts1->tv_sec = ts2->tv_sec;
-	ts2->tv_usec = ts2->tv_usec;
+	ts1->tv_usec = ts2->tv_usec;
 }
 
 float timestamp_diff(timestamp_t *t1, timestamp_t *t2)